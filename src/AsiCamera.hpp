@@ -5,19 +5,30 @@
 #include "Camera.hpp"
 #include "Image.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
 class AsiCamera : public Camera {
 public:
-	AsiCamera(int id) : m_id(id), m_opened(false), m_frame(0) {}
+	AsiCamera(int id) : m_id(id), m_opened(false), m_handle(false), m_capturing(false), m_frame(0), m_exposure(-1), m_gain(-1), m_bandwidth(-1), m_high_speed(false), m_bin(1), m_last_end(0) {}
 
+	// Can be called again after close, e.g. to recover a camera that stalled
+	// or was removed, the handle of the SDK is released first in that case
 	bool open() {
-		m_opened = (ASIOpenCamera(m_id) == ASI_SUCCESS && ASIInitCamera(m_id) == ASI_SUCCESS);
+		if (m_handle) {
+			ASICloseCamera(m_id);
+			m_handle = false;
+		}
+
+		m_handle = ASIOpenCamera(m_id) == ASI_SUCCESS;
+		m_opened = m_handle && ASIInitCamera(m_id) == ASI_SUCCESS;
 		if (!m_opened) {
 			return false;
 		}
 
 		// Apply some default values
 		ASIDisableDarkSubtract(m_id);
-		ASISetControlValue(m_id, ASI_BANDWIDTHOVERLOAD, 100, ASI_FALSE);
 		ASISetControlValue(m_id, ASI_WB_B, 99, ASI_FALSE);
 		ASISetControlValue(m_id, ASI_WB_R, 75, ASI_FALSE);
 		ASISetControlValue(m_id, ASI_GAMMA, 50, ASI_FALSE);
@@ -25,8 +36,14 @@ public:
 		ASISetControlValue(m_id, ASI_FLIP, 0, ASI_FALSE);
 		ASIStopExposure(m_id);
 
+		m_capturing = false;
+		m_exposure = -1;
+		m_gain = -1;
+		m_bandwidth = -1;
+
 		set_exposure(10000);
 		set_gain(0);
+		set_bandwidth(100, false);
 
 		m_opened = set_roi_format(ASI_IMG_Y8);
 		if (!m_opened) {
@@ -38,27 +55,92 @@ public:
 		return m_opened;
 	}
 
+	// Video capture is kept running as long as possible, restarting it costs
+	// USB renegotiation and warm-up frames. Starting or stopping twice is a no-op.
 	bool start_capture() {
-		return ASIStartVideoCapture(m_id) == ASI_SUCCESS;
+		if (!m_capturing) {
+			m_capturing = ASIStartVideoCapture(m_id) == ASI_SUCCESS;
+			m_last_end = 0;
+		}
+		return m_capturing;
 	}
 
 	bool stop_capture() {
+		if (!m_capturing) {
+			return true;
+		}
+		m_capturing = false;
 		return ASIStopVideoCapture(m_id) == ASI_SUCCESS;
 	}
 
+	// Exposure and gain can be changed while capturing
 	void set_exposure(int value) {
+		if (value == m_exposure) {
+			return;
+		}
+		m_exposure = value;
 		m_timeout = value*2+500;
 		ASISetControlValue(m_id, ASI_EXPOSURE, value, ASI_FALSE);
 	}
 
 	void set_gain(int value) {
+		if (value == m_gain) {
+			return;
+		}
+		m_gain = value;
 		ASISetControlValue(m_id, ASI_GAIN, value, ASI_FALSE);
 	}
 
+	// Both controls can be changed while capturing. Less bandwidth avoids
+	// dropped frames on slow USB hosts, the high speed mode uses the faster
+	// 10 bit ADC which is good enough for 8 bit frames.
+	bool set_bandwidth(int bandwidth, bool high_speed) {
+		if (bandwidth == m_bandwidth && high_speed == m_high_speed) {
+			return true;
+		}
+
+		bool success = ASISetControlValue(m_id, ASI_BANDWIDTHOVERLOAD, bandwidth, ASI_FALSE) == ASI_SUCCESS;
+		// Not every model has a high speed mode, that is not an error
+		ASISetControlValue(m_id, ASI_HIGH_SPEED_MODE, high_speed ? 1 : 0, ASI_FALSE);
+
+		if (success) {
+			m_bandwidth = bandwidth;
+			m_high_speed = high_speed;
+		}
+
+		return success;
+	}
+
+	std::string get_name() {
+		ASI_CAMERA_INFO info;
+
+		if (ASIGetCameraPropertyByID(m_id, &info) != ASI_SUCCESS) {
+			return "";
+		}
+
+		return info.Name;
+	}
+
+	// Cameras without a serial number are told apart by their ID, which
+	// only stays the same as long as the cameras are not replugged
+	std::string get_serial() {
+		ASI_SN sn;
+		char text[17];
+
+		if (ASIGetSerialNumber(m_id, &sn) != ASI_SUCCESS) {
+			return "ID" + std::to_string(m_id);
+		}
+
+		for (int i = 0; i < 8; ++ i) {
+			snprintf(text + 2 * i, 3, "%02x", sn.id[i]);
+		}
+		return text;
+	}
+
 	bool get_fullsize(int &width, int &height) { 
 		ASI_CAMERA_INFO info;
 
-		if (ASIGetCameraProperty(&info, m_id) != ASI_SUCCESS) {
+		if (ASIGetCameraPropertyByID(m_id, &info) != ASI_SUCCESS) {
 			return false;
 		}
 
@@ -70,39 +152,143 @@ public:
 
 	double get_pixelsize() {
 		ASI_CAMERA_INFO info;
-		ASIGetCameraProperty(&info, m_id);
+		ASIGetCameraPropertyByID(m_id, &info);
 		return info.PixelSize;
 	}
 
+	// The ROI is given in unbinned pixels. The start position can be moved
+	// while capturing, the SDK only requires a restart of the video capture if
+	// the size of the ROI or the binning changes.
 	bool set_roi(int cx, int cy, int width, int height) { 
+		// The SDK works in binned pixels, the width has to be a multiple of 8
+		// and the height a multiple of 2
+		int bin_width = (width / m_bin) & ~7;
+		int bin_height = (height / m_bin) & ~1;
+
+		if (bin_width == m_width && bin_height == m_height && m_bin == m_format_bin) {
+			return set_start_pos(cx, cy);
+		}
+
 		ASI_IMG_TYPE type;
-		int _w, _h, bin;
+		int _w, _h, _bin;
 
-		ASIGetROIFormat(m_id, &_w, &_h, &bin, &type);
-		m_width = width;
-		m_height = height;
+		bool restart = m_capturing;
+		if (restart) {
+			stop_capture();
+		}
+
+		// The size is only taken over once the SDK accepted it, the frames
+		// always have the size that was applied
+		ASIGetROIFormat(m_id, &_w, &_h, &_bin, &type);
+		bool success = ASISetROIFormat(m_id, bin_width, bin_height, m_bin, type) == ASI_SUCCESS;
+		if (success && !set_start_pos(cx, cy)) {
+			// Go back to the previous format, so that it still matches the
+			// position and the bin factor that the caller restores
+			ASISetROIFormat(m_id, _w, _h, _bin, type);
+			ASISetStartPos(m_id, m_roi_x / _bin, m_roi_y / _bin);
+			success = false;
+		} else if (success) {
+			m_width = bin_width;
+			m_height = bin_height;
+			m_format_bin = m_bin;
+			m_roi_width = bin_width * m_bin;
+			m_roi_height = bin_height * m_bin;
+		}
 
-		return ASISetROIFormat(m_id, width, height, bin, type) == ASI_SUCCESS
-			&& ASISetStartPos(m_id, cx, cy) == ASI_SUCCESS;
+		if (restart) {
+			start_capture();
+		}
+
+		return success;
 	}
 
+	// Hardware binning, reduces the transferred data by the square of the bin
+	// factor. Fails if the camera does not support the bin factor.
+	bool set_bin(int bin) {
+		if (bin == m_bin) {
+			return true;
+		}
+
+		ASI_CAMERA_INFO info;
+		if (ASIGetCameraPropertyByID(m_id, &info) != ASI_SUCCESS) {
+			return false;
+		}
+
+		bool supported = false;
+		for (int i = 0; i < 16 && info.SupportedBins[i] != 0; ++ i) {
+			supported |= info.SupportedBins[i] == bin;
+		}
+
+		if (!supported) {
+			return false;
+		}
+
+		int previous = m_bin;
+		m_bin = bin;
+		if (!set_roi(m_roi_x, m_roi_y, m_roi_width, m_roi_height)) {
+			m_bin = previous;
+			return false;
+		}
+		return true;
+	}
+
+	int get_bin() {
+		return m_bin;
+	}
+
+	// Total since the capture was started. Asking the SDK costs a round trip
+	// to the camera, so it is not done per frame and FrameInfo::dropped stays
+	// 0, callers compare the total before and after a burst instead.
 	int get_dropped_frames() {
-		int dropped;
+		int dropped = 0;
 		ASIGetDroppedFrames(m_id, &dropped);
 		return dropped;
 	}
 
-	bool get_data(Image& img) { 
+	bool get_data(Image& img, FrameInfo* info = nullptr) { 
 		m_frame += 1;
 
 		img.set(m_width, m_height);
 
-		return ASIGetVideoData(m_id, (unsigned char*)img.m_buffer, img.get_pixel_count(), m_timeout) == ASI_SUCCESS;
+		int64_t entry = monotonic_ns();
+		bool success = ASIGetVideoData(m_id, (unsigned char*)img.m_buffer, img.get_pixel_count(), m_timeout) == ASI_SUCCESS;
+		int64_t returned = monotonic_ns();
+
+		if (!success) {
+			return false;
+		}
+
+		// The SDK has no frame timestamps. A frame that we had to wait for
+		// finished its exposure just before the call returned. A frame that was
+		// already buffered by the SDK follows the previous one by the exposure
+		// time, but finished at the latest when we asked for it.
+		int64_t exposure_end = returned;
+		if (returned - entry <= 1000000) {
+			exposure_end = m_last_end > 0 ? std::min<int64_t>(m_last_end + m_exposure * 1000LL, entry) : entry;
+		}
+		m_last_end = exposure_end;
+
+		if (info != nullptr) {
+			info->timestamp = exposure_end;
+			info->exposure = m_exposure;
+			info->gain = m_gain;
+			info->roi_x = m_roi_x;
+			info->roi_y = m_roi_y;
+			info->roi_width = m_roi_width;
+			info->roi_height = m_roi_height;
+			info->bin = m_bin;
+			info->sequence = m_frame;
+			info->dropped = 0;
+		}
+
+		m_latency.add(monotonic_ns() - exposure_end);
+
+		return true;
 	}
 
 	void close() { 
 		if (m_opened) {
-			ASIStopVideoCapture(m_id);
+			stop_capture();
 			//ASICloseCamera(m_id);
 			m_opened = false;
 		}
@@ -121,14 +307,42 @@ private:
 	int m_id;
 	int m_timeout;
 	int m_frame;
+	int m_exposure, m_gain;
+	int m_bandwidth;
+	bool m_high_speed;
+	int m_bin, m_format_bin;
+	int64_t m_last_end; // Estimated end of the exposure of the previous frame, 0 after a restart
+	int m_roi_x, m_roi_y, m_roi_width, m_roi_height;
 	bool m_opened;
+	bool m_handle; // The SDK handle was opened, it stays open after close
+	bool m_capturing;
+
+	// Moves the ROI, the position is stored in unbinned pixels as applied
+	bool set_start_pos(int cx, int cy) {
+		if (ASISetStartPos(m_id, cx / m_bin, cy / m_bin) != ASI_SUCCESS) {
+			return false;
+		}
+
+		m_roi_x = cx / m_bin * m_bin;
+		m_roi_y = cy / m_bin * m_bin;
+		return true;
+	}
 
 	bool set_roi_format(ASI_IMG_TYPE type) {
 		ASI_IMG_TYPE _type;
-		int bin;
 
-		return ASIGetROIFormat(m_id, &m_width, &m_height, &bin, &_type) == ASI_SUCCESS
-			&& ASISetROIFormat(m_id, m_width, m_height, bin, type) == ASI_SUCCESS;
+		if (ASIGetROIFormat(m_id, &m_width, &m_height, &m_bin, &_type) != ASI_SUCCESS
+			|| ASISetROIFormat(m_id, m_width, m_height, m_bin, type) != ASI_SUCCESS) {
+			return false;
+		}
+
+		m_format_bin = m_bin;
+		m_roi_x = 0;
+		m_roi_y = 0;
+		m_roi_width = m_width * m_bin;
+		m_roi_height = m_height * m_bin;
+
+		return true;
 	}
 
 };
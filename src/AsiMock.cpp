@@ -0,0 +1,651 @@
+/*
+ * Mock of libASICamera2 for running the AsiCamera code paths without a camera.
+ * Build it with -DASI_MOCK=ON, the seeing binary is then linked against this
+ * library instead of the SDK. The mock is configured with environment variables:
+ *
+ *   ASI_MOCK_CAMERAS     Number of connected cameras (1)
+ *   ASI_MOCK_MODEL       Model name ("ZWO ASI Mock")
+ *   ASI_MOCK_WIDTH       Sensor size (1280 x 960)
+ *   ASI_MOCK_HEIGHT
+ *   ASI_MOCK_FRAMES      Directory with binary 8 bit PGM files that are served in
+ *                        order instead of a synthetic star, sets the sensor size
+ *   ASI_MOCK_FPS         Frame rate of a full frame at 100% bandwidth (30), smaller
+ *                        ROIs and binning are faster, the exposure time is a limit
+ *   ASI_MOCK_LATENCY     Time in ms from the end of the exposure until the frame
+ *                        can be read (2)
+ *   ASI_MOCK_DROP        Probability that a frame is dropped on USB (0)
+ *   ASI_MOCK_ERROR       Probability that ASIGetVideoData fails (0)
+ *   ASI_MOCK_FAIL_AFTER  Frames after which the camera is removed (0, never)
+ *   ASI_MOCK_RECONNECT   Time in ms after which a removed camera can be opened
+ *                        again (0, never), it is removed again after the same
+ *                        number of frames
+ *   ASI_MOCK_JITTER      RMS of the tip-tilt of the synthetic star in px (1)
+ *
+ * Frames are produced on a virtual timeline that starts with the video capture.
+ * Like the SDK only the newest finished frame is kept, frames that were not
+ * read in time are counted as dropped.
+ */
+#include "ASICamera2.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define MOCK_MAX_CAMERAS 8
+
+static double env_number(const char* name, double fallback) {
+	const char* value = getenv(name);
+	return value != nullptr && *value != '\0' ? atof(value) : fallback;
+}
+
+static std::string env_string(const char* name, const char* fallback) {
+	const char* value = getenv(name);
+	return value != nullptr && *value != '\0' ? value : fallback;
+}
+
+static int64_t now_us() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Reads a binary 8 bit PGM (P5) file
+static bool read_pgm(const std::string& path, std::vector<uint8_t>& data, int& width, int& height) {
+	std::ifstream file(path, std::ios::binary);
+	std::string magic;
+	int maxval;
+
+	if (!(file >> magic >> width >> height >> maxval) || magic != "P5" || maxval > 255) {
+		return false;
+	}
+
+	file.get();
+	data.resize(width * height);
+	file.read((char*)data.data(), data.size());
+
+	return (bool)file;
+}
+
+struct MockCamera {
+	std::mutex mutex;
+	bool opened = false;
+	bool capturing = false;
+
+	long controls[ASI_ANTI_DEW_HEATER + 1] = {0};
+
+	int width = 0, height = 0, bin = 1;
+	int start_x = 0, start_y = 0;
+	ASI_IMG_TYPE type = ASI_IMG_RAW8;
+
+	// Virtual timeline of the video capture, frame k finishes its exposure at
+	// origin + (k - first + 1) * interval
+	int64_t origin = 0;
+	int64_t first = 0;
+	int64_t next = 0;     // Index of the next frame that was not yet read
+	int64_t served = 0;   // Frames returned in total
+	bool removed = false;
+	int64_t removed_at = 0;
+	int dropped = 0;
+
+	std::mt19937 random{42};
+};
+
+static MockCamera cameras[MOCK_MAX_CAMERAS];
+
+struct MockConfig {
+	int count;
+	std::string model;
+	int width, height;
+	double fps, latency, drop, error, jitter;
+	int64_t fail_after;
+	double reconnect;
+	std::vector<std::vector<uint8_t>> frames;
+
+	// Drawing a normal sample per pixel would limit the frame rate of large
+	// frames, the read noise is taken from this table at a random offset
+	std::vector<double> noise;
+
+	MockConfig() {
+		count = std::min<int>(env_number("ASI_MOCK_CAMERAS", 1), MOCK_MAX_CAMERAS);
+		model = env_string("ASI_MOCK_MODEL", "ZWO ASI Mock");
+		width = env_number("ASI_MOCK_WIDTH", 1280);
+		height = env_number("ASI_MOCK_HEIGHT", 960);
+		fps = env_number("ASI_MOCK_FPS", 30);
+		latency = env_number("ASI_MOCK_LATENCY", 2) * 1000;
+		drop = std::min(env_number("ASI_MOCK_DROP", 0), 0.99);
+		error = env_number("ASI_MOCK_ERROR", 0);
+		fail_after = env_number("ASI_MOCK_FAIL_AFTER", 0);
+		reconnect = env_number("ASI_MOCK_RECONNECT", 0) * 1000;
+		jitter = env_number("ASI_MOCK_JITTER", 1);
+
+		std::mt19937 random(1);
+		std::normal_distribution<double> normal(0, 1.5);
+		for (int i = 0; i < 65536; ++ i) {
+			noise.push_back(normal(random));
+		}
+
+		std::string path = env_string("ASI_MOCK_FRAMES", "");
+		if (!path.empty()) {
+			load_frames(path);
+		}
+	}
+
+	void load_frames(const std::string& path) {
+		struct dirent **namelist;
+		int n = scandir(path.c_str(), &namelist, 0, alphasort);
+
+		for (int i = 0; i < n; ++ i) {
+			std::vector<uint8_t> data;
+			int w, h;
+
+			if (namelist[i]->d_name[0] != '.' && read_pgm(path + "/" + namelist[i]->d_name, data, w, h)) {
+				if (frames.empty()) {
+					width = w;
+					height = h;
+				}
+				if (w == width && h == height) {
+					frames.push_back(data);
+				}
+			}
+			free(namelist[i]);
+		}
+
+		if (n >= 0) {
+			free(namelist);
+		}
+
+		printf("ASI mock: loaded %zu frames from %s\n", frames.size(), path.c_str());
+	}
+};
+
+static MockConfig& config() {
+	static MockConfig instance;
+	return instance;
+}
+
+static MockCamera* get_camera(int id, ASI_ERROR_CODE& error) {
+	if (id < 0 || id >= config().count) {
+		error = ASI_ERROR_INVALID_ID;
+		return nullptr;
+	}
+
+	error = ASI_SUCCESS;
+	return &cameras[id];
+}
+
+#define LOCK_CAMERA(id, require_open) \
+	ASI_ERROR_CODE error; \
+	MockCamera* camera = get_camera(id, error); \
+	if (camera == nullptr) return error; \
+	std::lock_guard<std::mutex> lock(camera->mutex); \
+	if (require_open && !camera->opened) return ASI_ERROR_CAMERA_CLOSED; \
+	if (camera->removed) return ASI_ERROR_CAMERA_REMOVED;
+
+// Time between two frames in us, limited by the exposure and the transfer
+static int64_t frame_interval(MockCamera* camera) {
+	const MockConfig& cfg = config();
+	double bandwidth = std::max<long>(camera->controls[ASI_BANDWIDTHOVERLOAD], 40) / 100.0;
+	double speed = camera->controls[ASI_HIGH_SPEED_MODE] ? 1.2 : 1.0;
+	double fraction = (double)camera->width * camera->height / ((double)cfg.width * cfg.height);
+	double transfer = 1e6 / (cfg.fps * bandwidth * speed) * fraction;
+
+	return std::max<int64_t>(std::max<int64_t>(camera->controls[ASI_EXPOSURE], (int64_t)transfer), 1);
+}
+
+// Exposure or format changes take effect with the next frame
+static void restart_timeline(MockCamera* camera) {
+	if (camera->capturing) {
+		camera->origin = now_us();
+		camera->first = camera->next;
+	}
+}
+
+// Pixel of the sensor at full resolution
+static int sensor_pixel(int64_t frame, int x, int y, double star_x, double star_y, double peak) {
+	const MockConfig& cfg = config();
+
+	if (!cfg.frames.empty()) {
+		return cfg.frames[frame % cfg.frames.size()][y * cfg.width + x];
+	}
+
+	double dx = x - star_x;
+	double dy = y - star_y;
+	double r2 = dx*dx + dy*dy;
+	return r2 < 400 ? 10 + peak * std::exp(-r2 / (2 * 2.0 * 2.0)) : 10;
+}
+
+static void render_frame(MockCamera* camera, int64_t frame, unsigned char* buffer) {
+	const MockConfig& cfg = config();
+	std::normal_distribution<double> tilt(0, cfg.jitter);
+	size_t offset = camera->random();
+
+	// Synthetic star in the centre of the sensor, its brightness follows the
+	// exposure and the gain in 0.1 dB
+	double star_x = cfg.width / 2.0 + tilt(camera->random);
+	double star_y = cfg.height / 2.0 + tilt(camera->random);
+	double peak = 150 * camera->controls[ASI_EXPOSURE] / 10000.0 * std::pow(10, (camera->controls[ASI_GAIN] - 300) / 200.0);
+	int bin = camera->bin;
+
+	for (int y = 0; y < camera->height; ++ y) {
+		for (int x = 0; x < camera->width; ++ x) {
+			int sum = 0;
+			for (int by = 0; by < bin; ++ by) {
+				for (int bx = 0; bx < bin; ++ bx) {
+					sum += sensor_pixel(frame, (camera->start_x + x) * bin + bx, (camera->start_y + y) * bin + by, star_x, star_y, peak);
+				}
+			}
+
+			double value = sum / (double)(bin * bin);
+			if (cfg.frames.empty()) {
+				value += cfg.noise[(offset + y * 7919 + x) & 0xffff];
+			}
+			buffer[y * camera->width + x] = std::min(std::max(value, 0.0), 255.0);
+		}
+	}
+}
+
+extern "C" {
+
+int ASIGetNumOfConnectedCameras() {
+	return config().count;
+}
+
+int ASIGetProductIDs(int* /*pPIDs*/) {
+	return 0;
+}
+
+ASI_BOOL ASICameraCheck(int /*iVID*/, int /*iPID*/) {
+	return ASI_FALSE;
+}
+
+ASI_ERROR_CODE ASIGetCameraProperty(ASI_CAMERA_INFO *pASICameraInfo, int iCameraIndex) {
+	if (iCameraIndex < 0 || iCameraIndex >= config().count) {
+		return ASI_ERROR_INVALID_INDEX;
+	}
+
+	const MockConfig& cfg = config();
+	memset(pASICameraInfo, 0, sizeof(ASI_CAMERA_INFO));
+	snprintf(pASICameraInfo->Name, sizeof(pASICameraInfo->Name), "%s", cfg.model.c_str());
+	pASICameraInfo->CameraID = iCameraIndex;
+	pASICameraInfo->MaxWidth = cfg.width;
+	pASICameraInfo->MaxHeight = cfg.height;
+	pASICameraInfo->IsColorCam = ASI_FALSE;
+	pASICameraInfo->SupportedBins[0] = 1;
+	pASICameraInfo->SupportedBins[1] = 2;
+	pASICameraInfo->SupportedBins[2] = 4;
+	pASICameraInfo->SupportedVideoFormat[0] = ASI_IMG_RAW8;
+	pASICameraInfo->SupportedVideoFormat[1] = ASI_IMG_Y8;
+	pASICameraInfo->SupportedVideoFormat[2] = ASI_IMG_END;
+	pASICameraInfo->PixelSize = 3.75;
+	pASICameraInfo->IsUSB3Host = ASI_TRUE;
+	pASICameraInfo->IsUSB3Camera = ASI_TRUE;
+	pASICameraInfo->ElecPerADU = 1;
+	pASICameraInfo->BitDepth = 8;
+
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIGetCameraPropertyByID(int iCameraID, ASI_CAMERA_INFO *pASICameraInfo) {
+	return ASIGetCameraProperty(pASICameraInfo, iCameraID);
+}
+
+// A removed camera has to be closed and opened again once it reconnected
+ASI_ERROR_CODE ASIOpenCamera(int iCameraID) {
+	ASI_ERROR_CODE error;
+	MockCamera* camera = get_camera(iCameraID, error);
+	if (camera == nullptr) {
+		return error;
+	}
+
+	std::lock_guard<std::mutex> lock(camera->mutex);
+	if (camera->removed) {
+		if (config().reconnect <= 0 || now_us() - camera->removed_at < config().reconnect || camera->opened) {
+			return ASI_ERROR_CAMERA_REMOVED;
+		}
+		camera->removed = false;
+	}
+
+	camera->opened = true;
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIInitCamera(int iCameraID) {
+	LOCK_CAMERA(iCameraID, true);
+	camera->width = config().width;
+	camera->height = config().height;
+	camera->bin = 1;
+	camera->start_x = 0;
+	camera->start_y = 0;
+	camera->controls[ASI_EXPOSURE] = 10000;
+	camera->controls[ASI_BANDWIDTHOVERLOAD] = 50;
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASICloseCamera(int iCameraID) {
+	ASI_ERROR_CODE error;
+	MockCamera* camera = get_camera(iCameraID, error);
+	if (camera == nullptr) {
+		return error;
+	}
+
+	std::lock_guard<std::mutex> lock(camera->mutex);
+	camera->opened = false;
+	camera->capturing = false;
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIGetNumOfControls(int iCameraID, int * piNumberOfControls) {
+	LOCK_CAMERA(iCameraID, true);
+	*piNumberOfControls = ASI_ANTI_DEW_HEATER + 1;
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIGetControlCaps(int iCameraID, int iControlIndex, ASI_CONTROL_CAPS * pControlCaps) {
+	LOCK_CAMERA(iCameraID, true);
+	if (iControlIndex < 0 || iControlIndex > ASI_ANTI_DEW_HEATER) {
+		return ASI_ERROR_INVALID_CONTROL_TYPE;
+	}
+
+	memset(pControlCaps, 0, sizeof(ASI_CONTROL_CAPS));
+	snprintf(pControlCaps->Name, sizeof(pControlCaps->Name), "Control %d", iControlIndex);
+	pControlCaps->ControlType = (ASI_CONTROL_TYPE)iControlIndex;
+	pControlCaps->MinValue = iControlIndex == ASI_BANDWIDTHOVERLOAD ? 40 : 0;
+	pControlCaps->MaxValue = iControlIndex == ASI_EXPOSURE ? 2000000000 : (iControlIndex == ASI_GAIN ? 480 : 100);
+	pControlCaps->IsWritable = ASI_TRUE;
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIGetControlValue(int iCameraID, ASI_CONTROL_TYPE ControlType, long *plValue, ASI_BOOL *pbAuto) {
+	LOCK_CAMERA(iCameraID, true);
+	if (ControlType < 0 || ControlType > ASI_ANTI_DEW_HEATER) {
+		return ASI_ERROR_INVALID_CONTROL_TYPE;
+	}
+
+	*plValue = camera->controls[ControlType];
+	if (pbAuto != nullptr) {
+		*pbAuto = ASI_FALSE;
+	}
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASISetControlValue(int iCameraID, ASI_CONTROL_TYPE ControlType, long lValue, ASI_BOOL /*bAuto*/) {
+	LOCK_CAMERA(iCameraID, true);
+	if (ControlType < 0 || ControlType > ASI_ANTI_DEW_HEATER) {
+		return ASI_ERROR_INVALID_CONTROL_TYPE;
+	}
+
+	if (ControlType == ASI_BANDWIDTHOVERLOAD && (lValue < 40 || lValue > 100)) {
+		return ASI_ERROR_GENERAL_ERROR;
+	}
+
+	camera->controls[ControlType] = lValue;
+	if (ControlType == ASI_EXPOSURE || ControlType == ASI_BANDWIDTHOVERLOAD || ControlType == ASI_HIGH_SPEED_MODE) {
+		restart_timeline(camera);
+	}
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASISetROIFormat(int iCameraID, int iWidth, int iHeight, int iBin, ASI_IMG_TYPE Img_type) {
+	LOCK_CAMERA(iCameraID, true);
+
+	// Same constraints as the SDK
+	if (camera->capturing) {
+		return ASI_ERROR_VIDEO_MODE_ACTIVE;
+	}
+	if (iBin != 1 && iBin != 2 && iBin != 4) {
+		return ASI_ERROR_INVALID_SIZE;
+	}
+	if (iWidth <= 0 || iHeight <= 0 || iWidth % 8 != 0 || iHeight % 2 != 0
+		|| iWidth * iBin > config().width || iHeight * iBin > config().height) {
+		return ASI_ERROR_INVALID_SIZE;
+	}
+	if (Img_type != ASI_IMG_RAW8 && Img_type != ASI_IMG_Y8) {
+		return ASI_ERROR_INVALID_IMGTYPE;
+	}
+
+	camera->width = iWidth;
+	camera->height = iHeight;
+	camera->bin = iBin;
+	camera->type = Img_type;
+
+	// The SDK centres a new ROI on the sensor
+	camera->start_x = (config().width / iBin - iWidth) / 2;
+	camera->start_y = (config().height / iBin - iHeight) / 2;
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIGetROIFormat(int iCameraID, int *piWidth, int *piHeight, int *piBin, ASI_IMG_TYPE *pImg_type) {
+	LOCK_CAMERA(iCameraID, true);
+	*piWidth = camera->width;
+	*piHeight = camera->height;
+	*piBin = camera->bin;
+	*pImg_type = camera->type;
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASISetStartPos(int iCameraID, int iStartX, int iStartY) {
+	LOCK_CAMERA(iCameraID, true);
+	if (iStartX < 0 || iStartY < 0) {
+		return ASI_ERROR_OUTOF_BOUNDARY;
+	}
+
+	// Like the SDK, the position is clamped to the sensor
+	camera->start_x = std::min(iStartX, config().width / camera->bin - camera->width);
+	camera->start_y = std::min(iStartY, config().height / camera->bin - camera->height);
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIGetStartPos(int iCameraID, int *piStartX, int *piStartY) {
+	LOCK_CAMERA(iCameraID, true);
+	*piStartX = camera->start_x;
+	*piStartY = camera->start_y;
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIGetDroppedFrames(int iCameraID, int *piDropFrames) {
+	LOCK_CAMERA(iCameraID, true);
+	*piDropFrames = camera->dropped;
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIEnableDarkSubtract(int iCameraID, char* /*pcBMPPath*/) {
+	LOCK_CAMERA(iCameraID, true);
+	return ASI_ERROR_INVALID_PATH;
+}
+
+ASI_ERROR_CODE ASIDisableDarkSubtract(int iCameraID) {
+	LOCK_CAMERA(iCameraID, true);
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIStartVideoCapture(int iCameraID) {
+	LOCK_CAMERA(iCameraID, true);
+	if (camera->capturing) {
+		return ASI_ERROR_VIDEO_MODE_ACTIVE;
+	}
+
+	camera->capturing = true;
+	camera->origin = now_us();
+	camera->first = camera->next;
+	camera->dropped = 0;
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIStopVideoCapture(int iCameraID) {
+	LOCK_CAMERA(iCameraID, true);
+	camera->capturing = false;
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIGetVideoData(int iCameraID, unsigned char* pBuffer, long lBuffSize, int iWaitms) {
+	int64_t frame;
+	int64_t available;
+
+	{
+		LOCK_CAMERA(iCameraID, true);
+		if (!camera->capturing) {
+			return ASI_ERROR_INVALID_SEQUENCE;
+		}
+		if (lBuffSize < (long)camera->width * camera->height) {
+			return ASI_ERROR_BUFFER_TOO_SMALL;
+		}
+
+		std::uniform_real_distribution<double> chance(0, 1);
+		int64_t interval = frame_interval(camera);
+		int64_t latency = config().latency;
+
+		// Newest frame that can be read now, older unread frames were
+		// overwritten and count as dropped
+		int64_t newest = camera->first + (now_us() - camera->origin - latency) / interval - 1;
+		frame = std::max(camera->next, newest);
+		camera->dropped += frame - camera->next;
+
+		// Frames lost on USB
+		while (config().drop > 0 && chance(camera->random) < config().drop) {
+			camera->dropped += 1;
+			frame += 1;
+		}
+
+		if (config().error > 0 && chance(camera->random) < config().error) {
+			camera->next = frame + 1;
+			return ASI_ERROR_GENERAL_ERROR;
+		}
+
+		// Nothing arrives within the timeout, the frame is still read next time
+		available = camera->origin + (frame - camera->first + 1) * interval + latency;
+		if (available > now_us() + iWaitms * 1000LL) {
+			camera->next = frame;
+			available = 0;
+		}
+	}
+
+	if (available == 0) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(iWaitms));
+		return ASI_ERROR_TIMEOUT;
+	}
+
+	int64_t delay = available - now_us();
+	if (delay > 0) {
+		std::this_thread::sleep_for(std::chrono::microseconds(delay));
+	}
+
+	LOCK_CAMERA(iCameraID, true);
+	if (!camera->capturing || lBuffSize < (long)camera->width * camera->height) {
+		return ASI_ERROR_INVALID_SEQUENCE;
+	}
+
+	render_frame(camera, frame, pBuffer);
+	camera->next = frame + 1;
+	camera->served += 1;
+
+	if (config().fail_after > 0 && camera->served % config().fail_after == 0) {
+		camera->removed = true;
+		camera->removed_at = now_us();
+	}
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIPulseGuideOn(int iCameraID, ASI_GUIDE_DIRECTION /*direction*/) {
+	LOCK_CAMERA(iCameraID, true);
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIPulseGuideOff(int iCameraID, ASI_GUIDE_DIRECTION /*direction*/) {
+	LOCK_CAMERA(iCameraID, true);
+	return ASI_SUCCESS;
+}
+
+// Snap mode is not used by this project, it is not emulated
+ASI_ERROR_CODE ASIStartExposure(int iCameraID, ASI_BOOL /*bIsDark*/) {
+	LOCK_CAMERA(iCameraID, true);
+	return ASI_ERROR_INVALID_MODE;
+}
+
+ASI_ERROR_CODE ASIStopExposure(int iCameraID) {
+	LOCK_CAMERA(iCameraID, true);
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIGetExpStatus(int iCameraID, ASI_EXPOSURE_STATUS *pExpStatus) {
+	LOCK_CAMERA(iCameraID, true);
+	*pExpStatus = ASI_EXP_IDLE;
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIGetDataAfterExp(int iCameraID, unsigned char* /*pBuffer*/, long /*lBuffSize*/) {
+	LOCK_CAMERA(iCameraID, true);
+	return ASI_ERROR_INVALID_MODE;
+}
+
+ASI_ERROR_CODE ASIGetID(int iCameraID, ASI_ID* pID) {
+	LOCK_CAMERA(iCameraID, true);
+	memset(pID, 0, sizeof(ASI_ID));
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASISetID(int iCameraID, ASI_ID /*ID*/) {
+	LOCK_CAMERA(iCameraID, true);
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASIGetGainOffset(int iCameraID, int *pOffset_HighestDR, int *pOffset_UnityGain, int *pGain_LowestRN, int *pOffset_LowestRN) {
+	LOCK_CAMERA(iCameraID, true);
+	*pOffset_HighestDR = 0;
+	*pOffset_UnityGain = 0;
+	*pGain_LowestRN = 0;
+	*pOffset_LowestRN = 0;
+	return ASI_SUCCESS;
+}
+
+char* ASIGetSDKVersion() {
+	return (char*)"mock";
+}
+
+ASI_ERROR_CODE ASIGetCameraSupportMode(int iCameraID, ASI_SUPPORTED_MODE* /*pSupportedMode*/) {
+	LOCK_CAMERA(iCameraID, true);
+	return ASI_ERROR_INVALID_MODE;
+}
+
+ASI_ERROR_CODE ASIGetCameraMode(int iCameraID, ASI_CAMERA_MODE* mode) {
+	LOCK_CAMERA(iCameraID, true);
+	*mode = ASI_MODE_NORMAL;
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASISetCameraMode(int iCameraID, ASI_CAMERA_MODE mode) {
+	LOCK_CAMERA(iCameraID, true);
+	return mode == ASI_MODE_NORMAL ? ASI_SUCCESS : ASI_ERROR_INVALID_MODE;
+}
+
+ASI_ERROR_CODE ASISendSoftTrigger(int iCameraID, ASI_BOOL /*bStart*/) {
+	LOCK_CAMERA(iCameraID, true);
+	return ASI_ERROR_INVALID_MODE;
+}
+
+ASI_ERROR_CODE ASIGetSerialNumber(int iCameraID, ASI_SN* pSN) {
+	LOCK_CAMERA(iCameraID, true);
+	memset(pSN, 0, sizeof(ASI_SN));
+	pSN->id[7] = iCameraID;
+	return ASI_SUCCESS;
+}
+
+ASI_ERROR_CODE ASISetTriggerOutputIOConf(int iCameraID, ASI_TRIG_OUTPUT_PIN /*pin*/, ASI_BOOL /*bPinHigh*/, long /*lDelay*/, long /*lDuration*/) {
+	LOCK_CAMERA(iCameraID, true);
+	return ASI_ERROR_INVALID_MODE;
+}
+
+ASI_ERROR_CODE ASIGetTriggerOutputIOConf(int iCameraID, ASI_TRIG_OUTPUT_PIN /*pin*/, ASI_BOOL* /*bPinHigh*/, long* /*lDelay*/, long* /*lDuration*/) {
+	LOCK_CAMERA(iCameraID, true);
+	return ASI_ERROR_INVALID_MODE;
+}
+
+}
@@ -0,0 +1,493 @@
+#ifndef ASYNC_CAMERA_HPP
+#define ASYNC_CAMERA_HPP
+
+#include "Camera.hpp"
+#include "Image.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// Wraps any Camera and captures on its own thread into a triple buffer. The
+// capture thread always writes into the back buffer and swaps it with the
+// ready buffer, the consumer swaps the ready buffer with its front buffer.
+// Neither side ever waits for the other to finish copying, so processing of
+// one frame overlaps with the exposure of the next one. Frames must only be
+// consumed from one thread.
+//
+// The capture is kept running across ROI, exposure and gain changes, they are
+// applied between two frames and the wrapped camera decides whether it has to
+// restart its capture for it. Every change starts a new configuration
+// generation, frames of an older generation are never returned afterwards.
+//
+// A camera that is not paced by the real clock (see Camera::is_realtime) is
+// only asked for the next frame once the previous one was consumed, so that
+// a replay can run as fast as the frames are processed without losing any.
+//
+// A watchdog in the capture thread detects a stalled camera, either from
+// repeated failures to get a frame or from no frame at all for a while. The
+// camera is then closed and reopened in place and the last configuration is
+// applied again, the consumer only sees a few missing frames.
+#define SETTLE_FRAMES 1 // Frames dropped after a change, they may still be exposed with the old settings
+#define STALL_FAILURES 5 // Consecutive failed frames that count as a stall
+#define STALL_TIME 5000 // Milliseconds without a frame that count as a stall, at least 10 exposures
+#define RECOVER_MAX_DELAY 10000 // Milliseconds between attempts to reopen the camera at most
+
+class AsyncCamera : public Camera {
+public:
+	AsyncCamera(Camera* camera) : m_camera(camera), m_thread(nullptr), m_running(false),
+		m_back(0), m_ready(1), m_front(2), m_sequence(0), m_ready_seq(0), m_front_seq(0), m_consumed_seq(0),
+		m_roi_x(-1), m_roi_y(-1), m_roi_width(-1), m_roi_height(-1), m_timeout(5000),
+		m_exposure(-1), m_gain(-1), m_bandwidth(-1), m_high_speed(false), m_generation(0), m_pending(0), m_settle(0), m_recoveries(0) {
+		// The buffers are only read and copied to the consumer, views are
+		// replaced by copies before the camera is closed
+		m_camera->allow_views(true);
+	}
+
+	~AsyncCamera() {
+		stop_thread();
+		delete m_camera;
+	}
+
+	bool open() {
+		return m_camera->open();
+	}
+
+	bool get_fullsize(int &width, int &height) {
+		return m_camera->get_fullsize(width, height);
+	}
+
+	// Setting the same ROI again is ignored
+	bool set_roi(int cx, int cy, int width, int height) {
+		if (cx == m_roi_x && cy == m_roi_y && width == m_roi_width && height == m_roi_height) {
+			return true;
+		}
+
+		bool success;
+		configure([&] {
+			success = m_camera->set_roi(cx, cy, width, height);
+
+			// Kept under the camera lock, a recovery applies it again
+			if (success) {
+				m_roi_x = cx;
+				m_roi_y = cy;
+				m_roi_width = width;
+				m_roi_height = height;
+			}
+		});
+
+		return success;
+	}
+
+	bool set_bin(int bin) {
+		if (bin == m_camera->get_bin()) {
+			return true;
+		}
+
+		bool success;
+		configure([&] {
+			success = m_camera->set_bin(bin);
+		});
+
+		return success;
+	}
+
+	int get_bin() {
+		return m_camera->get_bin();
+	}
+
+	// Waits for a frame that was not returned before ("next frame" semantics)
+	bool get_data(Image& img, FrameInfo* info = nullptr) {
+		uint64_t sequence;
+		return get_next(img, sequence, info);
+	}
+
+	// Returns the newest frame that was captured, even if it was already
+	// returned before. Fails only if no frame was captured yet. The latency
+	// histogram of the AsyncCamera covers the time until the frame is returned
+	// here, including the time it waited in the mailbox.
+	bool get_latest(Image& img, uint64_t& sequence, FrameInfo* info = nullptr) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		if (m_ready_seq > m_front_seq) {
+			std::swap(m_front, m_ready);
+			std::swap(m_front_seq, m_ready_seq);
+		}
+
+		if (m_front_seq == 0) {
+			return false;
+		}
+
+		m_consumed_seq = m_front_seq;
+		sequence = m_front_seq;
+		m_consumed_cond.notify_all();
+
+		// The front buffer belongs to the consumer, copy without holding the
+		// lock unless it is a view that a reopen of the camera invalidates
+		if (!m_buffers[m_front].is_view()) {
+			lock.unlock();
+		}
+		img.copy_from(m_buffers[m_front]);
+		if (info != nullptr) {
+			*info = m_infos[m_front];
+		}
+
+		m_latency.add(monotonic_ns() - m_infos[m_front].timestamp);
+		return true;
+	}
+
+	// Waits until a frame newer than the last returned one is available and
+	// returns the newest one, frames in between are skipped. Fails if no new
+	// frame arrived within twice the exposure time.
+	bool get_next(Image& img, uint64_t& sequence, FrameInfo* info = nullptr) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		bool available = m_ready_cond.wait_for(lock, std::chrono::milliseconds(m_timeout), [this] {
+			return std::max(m_ready_seq, m_front_seq) > m_consumed_seq;
+		});
+
+		if (!available) {
+			return false;
+		}
+
+		lock.unlock();
+		return get_latest(img, sequence, info);
+	}
+
+	// Starts the capture thread, does nothing if it is already running
+	bool start_capture() {
+		if (m_running) {
+			return true;
+		}
+
+		if (!m_camera->start_capture()) {
+			return false;
+		}
+
+		// Frames from before the restart could have a different ROI or
+		// exposure, they must not be returned anymore
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_ready_seq = 0;
+			m_front_seq = 0;
+			m_consumed_seq = m_sequence;
+		}
+
+		m_running = true;
+		m_thread = new std::thread(AsyncCamera::exec, this);
+
+		return true;
+	}
+
+	bool stop_capture() {
+		stop_thread();
+		return m_camera->stop_capture();
+	}
+
+	bool is_capturing() const {
+		return m_running;
+	}
+
+	void set_exposure(int value) {
+		if (value == m_exposure) {
+			return;
+		}
+
+		m_timeout = value/1000*2+1000;
+		configure([&] {
+			m_camera->set_exposure(value);
+			m_exposure = value;
+		});
+	}
+
+	void set_gain(int value) {
+		if (value == m_gain) {
+			return;
+		}
+
+		configure([&] {
+			m_camera->set_gain(value);
+			m_gain = value;
+		});
+	}
+
+	bool set_bandwidth(int bandwidth, bool high_speed) {
+		if (bandwidth == m_bandwidth && high_speed == m_high_speed) {
+			return true;
+		}
+
+		bool success;
+		configure([&] {
+			success = m_camera->set_bandwidth(bandwidth, high_speed);
+			if (success) {
+				m_bandwidth = bandwidth;
+				m_high_speed = high_speed;
+			}
+		});
+
+		return success;
+	}
+
+	std::string get_name() {
+		return m_camera->get_name();
+	}
+
+	std::string get_serial() {
+		return m_camera->get_serial();
+	}
+
+	bool is_realtime() {
+		return m_camera->is_realtime();
+	}
+
+	// Configuration generation of the frames that are currently returned
+	uint64_t get_generation() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_generation;
+	}
+
+	int get_dropped_frames() {
+		return m_camera->get_dropped_frames();
+	}
+
+	int get_frame() {
+		return m_camera->get_frame();
+	}
+
+	// Number of times the camera was reopened after a stall
+	int get_recoveries() const {
+		return m_recoveries;
+	}
+
+	// Sequence number of the newest captured frame, 0 if none was captured
+	uint64_t get_sequence() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_sequence;
+	}
+
+	void close() {
+		stop_thread();
+		detach_views();
+		m_camera->close();
+	}
+
+private:
+	Camera* m_camera;
+	std::thread* m_thread;
+	std::atomic<bool> m_running;
+
+	std::mutex m_mutex;
+	std::condition_variable m_ready_cond;
+	std::condition_variable m_consumed_cond;
+
+	// Indices into m_buffers and the sequence number of the frame they hold
+	Image m_buffers[3];
+	FrameInfo m_infos[3];
+	int m_back, m_ready, m_front;
+	uint64_t m_sequence, m_ready_seq, m_front_seq, m_consumed_seq;
+
+	int m_roi_x, m_roi_y, m_roi_width, m_roi_height;
+	int m_timeout;
+	int m_exposure, m_gain;
+	int m_bandwidth;
+	bool m_high_speed;
+
+	// Serializes access to the wrapped camera between the capture thread and
+	// configuration changes, m_pending makes the capture thread step aside
+	std::mutex m_camera_mutex;
+	std::condition_variable m_camera_cond;
+	uint64_t m_generation;
+	int m_pending;
+	int m_settle;
+	std::atomic<int> m_recoveries;
+
+	// Applies a change to the wrapped camera between two frames and starts a
+	// new configuration generation
+	template<typename F>
+	void configure(F change) {
+		std::unique_lock<std::mutex> camera_lock(m_camera_mutex, std::defer_lock);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending += 1;
+		}
+		camera_lock.lock();
+
+		change();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pending -= 1;
+		m_generation += 1;
+		m_settle = m_running ? SETTLE_FRAMES : 0;
+
+		// Frames that were already captured belong to the old configuration
+		m_ready_seq = 0;
+		m_front_seq = 0;
+		m_consumed_seq = m_sequence;
+
+		m_camera_cond.notify_all();
+	}
+
+	void stop_thread() {
+		if (m_thread != nullptr) {
+			m_running = false;
+			m_thread->join();
+			delete m_thread;
+			m_thread = nullptr;
+		}
+	}
+
+	// Closes and reopens the wrapped camera and applies the last configuration
+	// again, called by the capture thread while it holds the camera lock
+	bool reopen() {
+		int bin = m_camera->get_bin();
+
+		detach_views();
+		m_camera->close();
+		if (!m_camera->open()) {
+			return false;
+		}
+
+		// Reopening resets the camera to the full frame without binning
+		if (!m_camera->set_bin(bin)
+			|| (m_roi_width > 0 && !m_camera->set_roi(m_roi_x, m_roi_y, m_roi_width, m_roi_height))) {
+			return false;
+		}
+
+		if (m_exposure >= 0) {
+			m_camera->set_exposure(m_exposure);
+		}
+		if (m_gain >= 0) {
+			m_camera->set_gain(m_gain);
+		}
+		if (m_bandwidth >= 0) {
+			m_camera->set_bandwidth(m_bandwidth, m_high_speed);
+		}
+
+		return m_camera->start_capture();
+	}
+
+	// Buffers that refer to memory of the camera get their own copy, so that
+	// they stay valid after it was closed
+	void detach_views() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (Image& buffer : m_buffers) {
+			if (buffer.is_view()) {
+				Image copy(buffer);
+				buffer.copy_from(copy);
+			}
+		}
+	}
+
+	// Tries to reopen the camera until it succeeds or the capture is stopped.
+	// The delay between attempts doubles up to RECOVER_MAX_DELAY, the camera
+	// lock is released while waiting so that configuration changes still go
+	// through and are applied by the next attempt.
+	void recover() {
+		int delay = 1000;
+
+		printf("AsyncCamera: camera stalled, reopening %s\n", m_camera->get_name().c_str());
+
+		while (m_running) {
+			bool success;
+			{
+				std::lock_guard<std::mutex> camera_lock(m_camera_mutex);
+				success = reopen();
+			}
+
+			if (success) {
+				m_recoveries += 1;
+				printf("AsyncCamera: camera recovered (%d recoveries)\n", m_recoveries.load());
+
+				// Frames before the stall may be old, drop them like after a change
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_generation += 1;
+				m_settle = SETTLE_FRAMES;
+				m_ready_seq = 0;
+				m_front_seq = 0;
+				m_consumed_seq = m_sequence;
+				return;
+			}
+
+			printf("AsyncCamera: reopening failed, next attempt in %d ms\n", delay);
+			for (int waited = 0; waited < delay && m_running; waited += 100) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			}
+			delay = std::min(delay * 2, RECOVER_MAX_DELAY);
+		}
+	}
+
+	// Waits until the ready frame was consumed, the next one is then captured
+	// while the consumer processes it. Returns false after a timeout, so that
+	// the caller can check whether the capture was stopped.
+	bool wait_consumed() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_consumed_cond.wait_for(lock, std::chrono::milliseconds(100), [this] {
+			return m_ready_seq <= m_consumed_seq;
+		});
+	}
+
+	static void exec(AsyncCamera* camera) {
+		const bool realtime = camera->m_camera->is_realtime();
+		int failures = 0;
+		auto last_frame = std::chrono::steady_clock::now();
+
+		while (camera->m_running) {
+			if (!realtime) {
+				if (!camera->wait_consumed()) {
+					continue;
+				}
+				last_frame = std::chrono::steady_clock::now();
+			}
+
+			std::unique_lock<std::mutex> camera_lock(camera->m_camera_mutex);
+
+			// Let pending configuration changes go first
+			camera->m_camera_cond.wait(camera_lock, [camera] {
+				std::lock_guard<std::mutex> lock(camera->m_mutex);
+				return camera->m_pending == 0;
+			});
+
+			FrameInfo& info = camera->m_infos[camera->m_back];
+			if (!camera->m_camera->get_data(camera->m_buffers[camera->m_back], &info)) {
+				int stall_time = std::max(STALL_TIME, camera->m_exposure / 100);
+				auto since = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - last_frame);
+
+				if (++ failures >= STALL_FAILURES || since.count() > stall_time) {
+					camera_lock.unlock();
+					camera->recover();
+					failures = 0;
+					last_frame = std::chrono::steady_clock::now();
+				}
+				continue;
+			}
+
+			failures = 0;
+			last_frame = std::chrono::steady_clock::now();
+
+			std::lock_guard<std::mutex> lock(camera->m_mutex);
+			if (camera->m_settle > 0) {
+				camera->m_settle -= 1;
+				continue;
+			}
+
+			// The ready frame is replaced without ever being returned, its count
+			// of dropped frames must not get lost
+			if (camera->m_ready_seq > camera->m_consumed_seq) {
+				info.dropped += camera->m_infos[camera->m_ready].dropped;
+			}
+
+			std::swap(camera->m_back, camera->m_ready);
+			camera->m_ready_seq = ++ camera->m_sequence;
+			camera->m_ready_cond.notify_all();
+		}
+	}
+};
+
+#endif // ASYNC_CAMERA_HPP
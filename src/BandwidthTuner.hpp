@@ -0,0 +1,191 @@
+#ifndef BANDWIDTH_TUNER_HPP
+#define BANDWIDTH_TUNER_HPP
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+
+#define bandwidth_filename "bandwidth.txt" // Tuned settings per camera
+
+#define BANDWIDTH_MIN 40
+#define BANDWIDTH_MAX 100
+#define BANDWIDTH_STEP 10
+
+// Tunes the USB bandwidth and the high speed mode of a camera from the frame
+// rate that was delivered during a burst. Dropped frames lower the score, so
+// the tuner settles on the fastest settings that the USB host can keep up
+// with. It is a simple hill climb: starting from the best known settings it
+// tries less bandwidth, more bandwidth and toggling the high speed mode, and
+// keeps moving in a direction as long as the score improves. Once no move
+// improves the score the settings are stored for the camera, which is told
+// apart from others of the same model by its serial number. When frames start
+// to be dropped again the search is restarted.
+class BandwidthTuner {
+public:
+	BandwidthTuner(const std::string& model, const std::string& serial) : m_key(serial.empty() ? model : model + "#" + serial), m_bandwidth(BANDWIDTH_MAX), m_high_speed(false),
+		m_best_bandwidth(BANDWIDTH_MAX), m_best_high_speed(false), m_best_score(0), m_move(0), m_failed(0), m_converged(false) {
+		load();
+		m_bandwidth = m_best_bandwidth;
+		m_high_speed = m_best_high_speed;
+	}
+
+	int get_bandwidth() const {
+		return m_bandwidth;
+	}
+
+	bool get_high_speed() const {
+		return m_high_speed;
+	}
+
+	bool is_converged() const {
+		return m_converged;
+	}
+
+	// Reports a burst in which the camera delivered the given number of frames
+	// and dropped some within the duration in seconds. Returns true if the
+	// settings for the next burst changed.
+	bool report(int frames, int dropped, double seconds) {
+		if (frames <= 0 || seconds <= 0) {
+			return false;
+		}
+
+		double score = frames / seconds * frames / (frames + dropped);
+		bool trial = m_bandwidth != m_best_bandwidth || m_high_speed != m_best_high_speed;
+
+		if (m_converged) {
+			// Conditions like exposure or ROI change between bursts, follow the
+			// score of the stored settings and only search again on drops
+			m_best_score = score;
+			if (dropped * 100 <= frames) {
+				return false;
+			}
+
+			printf("Bandwidth: %d frames dropped, searching again\n", dropped);
+			m_converged = false;
+			m_failed = 0;
+		} else if (!trial) {
+			m_best_score = score;
+		} else if (score > m_best_score * 1.02) {
+			printf("Bandwidth: %d%%%s improved to %0.1f fps\n", m_bandwidth, m_high_speed ? " high speed" : "", score);
+			m_best_bandwidth = m_bandwidth;
+			m_best_high_speed = m_high_speed;
+			m_best_score = score;
+			m_failed = 0;
+		} else {
+			next_move();
+		}
+
+		return propose();
+	}
+
+private:
+	std::string m_key; // Entry in the file
+	int m_bandwidth;
+	bool m_high_speed;
+	int m_best_bandwidth;
+	bool m_best_high_speed;
+	double m_best_score;
+	int m_move; // 0: less bandwidth, 1: more bandwidth, 2: toggle high speed
+	int m_failed;
+	bool m_converged;
+
+	void next_move() {
+		m_move = (m_move + 1) % 3;
+		m_failed += 1;
+	}
+
+	// Picks the settings of the next burst, returns true if they changed
+	bool propose() {
+		int bandwidth = m_bandwidth;
+		bool high_speed = m_high_speed;
+
+		for (;;) {
+			if (m_failed >= 3) {
+				m_converged = true;
+				m_bandwidth = m_best_bandwidth;
+				m_high_speed = m_best_high_speed;
+				printf("Bandwidth: settled on %d%%%s with %0.1f fps\n", m_bandwidth, m_high_speed ? " high speed" : "", m_best_score);
+				store();
+				break;
+			}
+
+			m_bandwidth = m_best_bandwidth;
+			m_high_speed = m_best_high_speed;
+
+			if (m_move == 0) {
+				m_bandwidth -= BANDWIDTH_STEP;
+			} else if (m_move == 1) {
+				m_bandwidth += BANDWIDTH_STEP;
+			} else {
+				m_high_speed = !m_high_speed;
+			}
+
+			if (m_bandwidth >= BANDWIDTH_MIN && m_bandwidth <= BANDWIDTH_MAX) {
+				break;
+			}
+
+			next_move();
+		}
+
+		return bandwidth != m_bandwidth || high_speed != m_high_speed;
+	}
+
+	// The tuners of all cameras share the file
+	static std::mutex& file_mutex() {
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	// The file contains one line per camera: model#serial=bandwidth,high_speed
+	std::map<std::string, std::string> read_file() {
+		std::map<std::string, std::string> values;
+		std::ifstream file(bandwidth_filename);
+		std::string line;
+
+		while (std::getline(file, line)) {
+			int deli = line.rfind('=');
+			if (deli > 0) {
+				values[line.substr(0, deli)] = line.substr(deli+1);
+			}
+		}
+
+		return values;
+	}
+
+	void load() {
+		std::lock_guard<std::mutex> lock(file_mutex());
+		std::map<std::string, std::string> values = read_file();
+		int bandwidth, high_speed;
+
+		if (values.find(m_key) != values.end()
+			&& sscanf(values[m_key].c_str(), "%d,%d", &bandwidth, &high_speed) == 2) {
+			m_best_bandwidth = std::min(std::max(bandwidth, BANDWIDTH_MIN), BANDWIDTH_MAX);
+			m_best_high_speed = high_speed != 0;
+			std::cout << "Loaded bandwidth " << m_best_bandwidth << "% for " << m_key << std::endl;
+		}
+	}
+
+	bool store() {
+		std::lock_guard<std::mutex> lock(file_mutex());
+		std::map<std::string, std::string> values = read_file();
+		values[m_key] = std::to_string(m_best_bandwidth) + "," + (m_best_high_speed ? "1" : "0");
+
+		std::ofstream file(bandwidth_filename);
+		if (!file.is_open()) {
+			std::cout << "Failed to open '" << bandwidth_filename << "' in BandwidthTuner::store" << std::endl;
+			return false;
+		}
+
+		for (auto it = values.begin(); it != values.end(); ++ it) {
+			file << it->first << '=' << it->second << std::endl;
+		}
+
+		return true;
+	}
+};
+
+#endif // BANDWIDTH_TUNER_HPP
@@ -2,24 +2,63 @@
 #define CAMERA_HPP
 
 #include <cstdint>
+#include <string>
 
+#include "FrameInfo.hpp"
 #include "Image.hpp"
 
 // This is our Camera interface. Both our real ASI Camera and the "virtual Camera" for testing implement
 // this interface. This allows us to easily interchange the real and the test camera.
 class Camera {
 public:
+	virtual ~Camera() {}
+
 	virtual bool open() = 0;
 	virtual bool get_fullsize(int &width, int &height) = 0;
 	virtual bool set_roi(int cx, int cy, int width, int height) = 0;
-	virtual bool get_data(Image& img) = 0;
+	// ROI coordinates are always unbinned sensor pixels, the frames returned by
+	// get_data are smaller by the bin factor
+	virtual bool set_bin(int bin) = 0;
+	virtual int  get_bin() = 0;
+	// Fills in info if given, see FrameInfo
+	virtual bool get_data(Image& img, FrameInfo* info = nullptr) = 0;
 	virtual bool start_capture() = 0;
 	virtual bool stop_capture() = 0;
 	virtual void set_exposure(int value) = 0;
 	virtual void set_gain(int value) = 0;
+	// USB bandwidth in percent and the high speed mode of the sensor, returns
+	// false if the camera has no such controls
+	virtual bool set_bandwidth(int bandwidth, bool high_speed) = 0;
+	// Model name, used to store settings per camera model
+	virtual std::string get_name() = 0;
+	// Tells cameras of the same model apart, empty if there is nothing to
+	// tell apart
+	virtual std::string get_serial() {
+		return "";
+	}
 	virtual int  get_dropped_frames() = 0;
 	virtual int  get_frame() = 0;
 	virtual void close() = 0;
+
+	// Cameras that are paced by the real clock drop frames that are not
+	// consumed in time, a replay that runs as fast as the frames are processed
+	// returns false and gets every frame
+	virtual bool is_realtime() {
+		return true;
+	}
+
+	// Lets get_data return views into memory of the camera instead of copies
+	// if the caller only reads them and drops them before close. Cameras that
+	// always copy ignore it.
+	virtual void allow_views(bool allowed) {}
+
+	// Time from the end of the exposure until get_data returned the frame
+	LatencyHistogram& get_latency() {
+		return m_latency;
+	}
+
+protected:
+	LatencyHistogram m_latency;
 };
 
 #endif // CAMERA_HPP
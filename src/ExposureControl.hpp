@@ -0,0 +1,151 @@
+#ifndef EXPOSURE_CONTROL_HPP
+#define EXPOSURE_CONTROL_HPP
+
+#include "Image.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#define CLIPPED_RADIUS 2 // Half size of the box around the peak that is checked for clipped pixels
+#define CLIPPED_PIXELS 2 // Clipped pixels in that box from which the star counts as clipped
+
+/*
+ * Closed loop controller for gain and exposure. The star signal above the
+ * background is modelled as proportional to exposure * 10^(gain/200), the
+ * gain of ASI cameras is given in 0.1 dB. From the peak and background of a
+ * frame the factor that brings the peak to the target is calculated and
+ * applied in one step, so that the controller converges in 2-3 frames. A
+ * clipped star gives no usable peak, then the signal is reduced by large
+ * steps first.
+ *
+ * Short exposures freeze the turbulence, so the controller changes the gain
+ * first and only touches the exposure once the gain hits its limits. The
+ * exposure is never raised above the configured maximum.
+ */
+class ExposureController {
+public:
+  ExposureController()
+      : m_exposure(0), m_gain(0), m_min_exposure(32), m_max_exposure(0),
+        m_max_gain(0), m_target(180), m_peak(0), m_background(0) {}
+
+  // Limits of the controller, exposure in us
+  void set_limits(int max_exposure, int max_gain) {
+    m_max_exposure = max_exposure;
+    m_max_gain = max_gain;
+    m_exposure = std::min(std::max(m_exposure, m_min_exposure), m_max_exposure);
+    m_gain = std::min(m_gain, m_max_gain);
+  }
+
+  void set_target(int target) { m_target = target; }
+
+  void reset(int exposure, int gain) {
+    m_exposure = exposure;
+    m_gain = gain;
+  }
+
+  /*
+   * Measures the frame and calculates the exposure and gain for the next
+   * one. Returns true if the peak of this frame is already close enough to
+   * the target, in that case nothing is changed.
+   */
+  bool update(const Image &frame) {
+    measure(frame);
+
+    double signal = m_peak - m_background;
+    double wanted = m_target - m_background;
+
+    if (wanted <= 0) {
+      return false;
+    }
+
+    if (m_peak < SATURATION_LEVEL && std::abs(m_peak - m_target) <= m_target * 0.15) {
+      return true;
+    }
+
+    double factor;
+    if (m_peak >= SATURATION_LEVEL) {
+      // The real peak is unknown, step down in large steps until the star is
+      // no longer clipped and the model can be used again
+      factor = 0.25 * wanted / (SATURATION_LEVEL - m_background);
+    } else if (signal < 5) {
+      // No star visible, increase the signal as much as allowed per step
+      factor = 8;
+    } else {
+      factor = wanted / signal;
+    }
+
+    factor = std::min(std::max(factor, 1 / 16.0), 16.0);
+
+    // Apply as much as possible using the gain
+    int gain = m_gain + std::lround(200 * std::log10(factor));
+    gain = std::min(std::max(gain, 0), m_max_gain);
+    factor /= std::pow(10, (gain - m_gain) / 200.0);
+    m_gain = gain;
+
+    // Remaining factor is applied to the exposure
+    int exposure = std::lround(m_exposure * factor);
+    m_exposure = std::min(std::max(exposure, m_min_exposure), m_max_exposure);
+
+    return false;
+  }
+
+  int get_exposure() const { return m_exposure; }
+
+  int get_gain() const { return m_gain; }
+
+  int get_peak() const { return m_peak; }
+
+  int get_background() const { return m_background; }
+
+private:
+  int m_exposure, m_gain;
+  int m_min_exposure, m_max_exposure;
+  int m_max_gain;
+  int m_target;
+  int m_peak, m_background;
+
+  // The peak is taken from the smoothed image so that hot pixels are ignored,
+  // the background is the median of the frame
+  void measure(const Image &frame) {
+    int histogram[256] = {0};
+    int peak = 0;
+    int peak_x = 0, peak_y = 0;
+
+    for (int i = 0; i < frame.get_pixel_count(); ++i) {
+      histogram[frame.m_buffer[i]] += 1;
+    }
+
+    for (int y = 1; y < frame.get_height() - 1; ++y) {
+      for (int x = 1; x < frame.get_width() - 1; ++x) {
+        int value = smooth_pixel(frame, x, y);
+        if (value > peak) {
+          peak = value;
+          peak_x = x;
+          peak_y = y;
+        }
+      }
+    }
+
+    int count = 0;
+    m_background = 0;
+    while (m_background < 255 && count + histogram[m_background] < frame.get_pixel_count() / 2) {
+      count += histogram[m_background++];
+    }
+
+    // A clipped star is reported as saturated even if smoothing lowered it.
+    // Only clipped pixels around the star count, a single one is a hot pixel
+    // or a cosmic ray.
+    int clipped = 0;
+    for (int y = std::max(peak_y - CLIPPED_RADIUS, 0); y <= std::min(peak_y + CLIPPED_RADIUS, frame.get_height() - 1); ++y) {
+      for (int x = std::max(peak_x - CLIPPED_RADIUS, 0); x <= std::min(peak_x + CLIPPED_RADIUS, frame.get_width() - 1); ++x) {
+        clipped += frame.get_pixel(x, y) >= SATURATION_LEVEL;
+      }
+    }
+
+    m_peak = clipped >= CLIPPED_PIXELS ? SATURATION_LEVEL : peak / 16;
+  }
+};
+
+#endif // EXPOSURE_CONTROL_HPP
@@ -0,0 +1,49 @@
+#ifndef FITS_WRITER_HPP
+#define FITS_WRITER_HPP
+
+#include "FrameInfo.hpp"
+#include "Image.hpp"
+#include "ThreadPool.hpp"
+
+#include <future>
+#include <string>
+
+// Writes FITS images on its own I/O thread, so that the capture and the
+// webinterface never wait for the disk. The image is copied when it is
+// queued, the futures tell when and whether it was written.
+class FitsWriter {
+public:
+	FitsWriter() : m_io(1) {}
+
+	std::future<bool> save(const Image& img, const FitsHeader& header, const std::string& path) {
+		Image copy(img);
+		return m_io.submit([copy, header, path] {
+			return copy.save_fits(path, header);
+		});
+	}
+
+	// The file in memory, e.g. to send it to the webinterface
+	std::future<std::string> encode(const Image& img, const FitsHeader& header) {
+		Image copy(img);
+		return m_io.submit([copy, header] {
+			return copy.encode_fits(header);
+		});
+	}
+
+	// Header of a frame, the plate scale is in arcsec per unbinned pixel
+	static FitsHeader make_header(const FrameInfo& info, double plate_scale, const std::string& instrument) {
+		FitsHeader header;
+		header.exposure = info.exposure;
+		header.gain = info.gain;
+		header.utc = info.timestamp != 0 ? info.timestamp + realtime_offset() : 0;
+		header.bin = info.bin;
+		header.plate_scale = plate_scale;
+		header.instrument = instrument;
+		return header;
+	}
+
+private:
+	ThreadPool m_io;
+};
+
+#endif // FITS_WRITER_HPP
@@ -0,0 +1,270 @@
+#ifndef FLIGHT_RECORDER_HPP
+#define FLIGHT_RECORDER_HPP
+
+#include "FrameInfo.hpp"
+#include "Image.hpp"
+#include "SerRecorder.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define FLIGHT_RECORDER_SIZE (64 << 20) // Bytes of pixels kept in memory
+#define FLIGHT_RECORDER_FRAMES 16384    // Frames kept in memory
+
+// Keeps the most recent frames and their metadata in memory, so that they can
+// be looked at after something went wrong. Everything is allocated up front:
+// the pixels go into a byte ring of fixed size and the metadata into a fixed
+// number of entries, adding a frame is a memcpy and evicts the oldest ones.
+//
+// A dump writes the frames that are in the ring at the time of the trigger
+// on its own thread, one SER file per run of frames of the same size plus a
+// text file with the metadata. While the dump runs, frames that would
+// overwrite ones that are not written yet are not recorded.
+class FlightRecorder {
+public:
+	FlightRecorder(size_t bytes, int frames) : m_size(bytes), m_capacity(frames), m_seconds(10),
+		m_first(0), m_next(0), m_position(0), m_dumping(false), m_dump_next(0), m_dump_end(0), m_skipped(0), m_running(true) {
+		m_data = (uint8_t*)malloc(m_size);
+		m_entries.resize(m_capacity);
+		m_thread = new std::thread(FlightRecorder::exec, this);
+	}
+
+	~FlightRecorder() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_running = false;
+		}
+		m_cond.notify_all();
+		m_thread->join();
+		delete m_thread;
+		free(m_data);
+	}
+
+	// Frames older than this relative to the newest one are evicted
+	void set_seconds(double seconds) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_seconds = seconds;
+	}
+
+	// Returns false if the frame is not recorded because a dump still needs
+	// the space or it is larger than the ring
+	bool add(const Image& img, const FrameInfo& info) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		uint64_t size = img.get_pixel_count();
+
+		if (size == 0 || size > m_size) {
+			return false;
+		}
+
+		// Positions grow forever, a frame never wraps around the end of the ring
+		uint64_t start = m_position;
+		if (start / m_size != (start + size - 1) / m_size) {
+			start = (start / m_size + 1) * m_size;
+		}
+
+		while (m_first < m_next) {
+			const Entry& oldest = m_entries[m_first % m_capacity];
+			bool full = start + size - oldest.start > m_size || m_next - m_first >= m_capacity;
+			bool old = info.timestamp - oldest.info.timestamp > m_seconds * 1e9;
+
+			if (!full && !old) {
+				break;
+			}
+
+			// Only frames that the dump does not need can be evicted
+			if (m_dumping && m_first >= m_dump_next && m_first < m_dump_end) {
+				if (full) {
+					m_skipped += 1;
+					return false;
+				}
+				break;
+			}
+
+			m_first += 1;
+		}
+
+		Entry& entry = m_entries[m_next % m_capacity];
+		entry.start = start;
+		entry.width = img.get_width();
+		entry.height = img.get_height();
+		entry.info = info;
+		memcpy(m_data + start % m_size, img.m_buffer, size);
+
+		m_position = start + size;
+		m_next += 1;
+
+		return true;
+	}
+
+	// Starts a dump of all frames in the ring, returns false if one is still
+	// running. The files are named prefix_<run>.ser and prefix.txt.
+	bool dump(const std::string& prefix, const std::string& reason, const std::string& instrument) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_dumping || m_first == m_next) {
+			return false;
+		}
+
+		printf("FlightRecorder: dumping %d frames to %s, %s\n", (int)(m_next - m_first), prefix.c_str(), reason.c_str());
+
+		m_dumping = true;
+		m_dump_next = m_first;
+		m_dump_end = m_next;
+		m_prefix = prefix;
+		m_reason = reason;
+		m_instrument = instrument;
+		m_skipped = 0;
+		m_cond.notify_all();
+
+		return true;
+	}
+
+	bool is_dumping() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_dumping;
+	}
+
+private:
+	struct Entry {
+		uint64_t start; // Position of the first byte, the ring index is start % m_size
+		int width, height;
+		FrameInfo info;
+	};
+
+	uint8_t* m_data;
+	uint64_t m_size;
+	std::vector<Entry> m_entries;
+	uint64_t m_capacity;
+	double m_seconds;
+
+	// Frames from m_first to m_next are in the ring, m_position is where the
+	// next one is written. All of them only ever grow.
+	uint64_t m_first, m_next;
+	uint64_t m_position;
+
+	std::thread* m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	bool m_dumping;
+	uint64_t m_dump_next, m_dump_end; // Frames that the dump still has to write
+	int m_skipped;
+	bool m_running;
+	std::string m_prefix, m_reason, m_instrument;
+
+	// Writes the frames one run of equal size after the other, the pixels are
+	// read from the ring without the lock as add does not touch them anymore
+	void write_dump() {
+		int64_t offset = realtime_offset();
+		FILE* ser = nullptr;
+		FILE* meta = fopen((m_prefix + ".txt").c_str(), "w");
+		std::vector<int64_t> timestamps;
+		int run = 0, width = 0, height = 0, frames = 0;
+		int index = 0; // Frame within the run, counted even if its file could not be opened
+		uint8_t header[SER_HEADER_SIZE];
+
+		if (meta != nullptr) {
+			fprintf(meta, "# %s\n# file\tframe\tsequence\ttimestamp_ns\texposure_us\tgain\troi_x\troi_y\troi_width\troi_height\tbin\tdropped\n", m_reason.c_str());
+		}
+
+		for (;;) {
+			Entry entry;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_dump_next >= m_dump_end) {
+					break;
+				}
+				entry = m_entries[m_dump_next % m_capacity];
+			}
+
+			// A new file for every change of the frame size
+			if (run == 0 || entry.width != width || entry.height != height) {
+				finish_ser(ser, width, height, timestamps);
+				width = entry.width;
+				height = entry.height;
+				run += 1;
+				index = 0;
+
+				ser = fopen((m_prefix + "_" + std::to_string(run) + ".ser").c_str(), "wb");
+				if (ser != nullptr) {
+					SerRecorder::make_header(header, width, height, 0, m_instrument, 0);
+					fwrite(header, 1, SER_HEADER_SIZE, ser);
+				}
+			}
+
+			if (ser != nullptr) {
+				fwrite(m_data + entry.start % m_size, 1, (size_t)width * height, ser);
+				timestamps.push_back(SerRecorder::to_ticks(entry.info.timestamp, offset));
+			}
+
+			if (meta != nullptr) {
+				const FrameInfo& info = entry.info;
+				fprintf(meta, "%d\t%d\t%llu\t%lld\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n", run, index,
+					(unsigned long long)info.sequence, (long long)info.timestamp, info.exposure, info.gain,
+					info.roi_x, info.roi_y, info.roi_width, info.roi_height, info.bin, info.dropped);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_dump_next += 1;
+			}
+			index += 1;
+			frames += 1;
+		}
+
+		finish_ser(ser, width, height, timestamps);
+		if (meta != nullptr) {
+			fclose(meta);
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		printf("FlightRecorder: dumped %d frames in %d files, %d frames not recorded meanwhile\n", frames, run, m_skipped);
+	}
+
+	// Appends the timestamps and writes the header with the frame count
+	void finish_ser(FILE*& ser, int width, int height, std::vector<int64_t>& timestamps) {
+		if (ser == nullptr) {
+			timestamps.clear();
+			return;
+		}
+
+		uint8_t header[SER_HEADER_SIZE];
+		fwrite(timestamps.data(), sizeof(int64_t), timestamps.size(), ser);
+		SerRecorder::make_header(header, width, height, timestamps.size(), m_instrument, timestamps.empty() ? 0 : timestamps.front());
+		fseek(ser, 0, SEEK_SET);
+		fwrite(header, 1, SER_HEADER_SIZE, ser);
+		fclose(ser);
+
+		ser = nullptr;
+		timestamps.clear();
+	}
+
+	static void exec(FlightRecorder* recorder) {
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(recorder->m_mutex);
+				recorder->m_cond.wait(lock, [recorder] {
+					return recorder->m_dumping || !recorder->m_running;
+				});
+
+				if (!recorder->m_running) {
+					return;
+				}
+			}
+
+			recorder->write_dump();
+
+			std::lock_guard<std::mutex> lock(recorder->m_mutex);
+			recorder->m_dumping = false;
+		}
+	}
+};
+
+#endif // FLIGHT_RECORDER_HPP
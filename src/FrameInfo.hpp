@@ -0,0 +1,96 @@
+#ifndef FRAME_INFO_HPP
+#define FRAME_INFO_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <time.h>
+
+// Metadata of a captured frame, filled in by the camera in get_data
+struct FrameInfo {
+	int64_t timestamp = 0;  // Monotonic time of the end of the exposure in ns
+	int exposure = 0;       // Exposure time in us
+	int gain = 0;
+	int roi_x = 0, roi_y = 0, roi_width = 0, roi_height = 0; // ROI in unbinned pixels
+	int bin = 1;
+	uint64_t sequence = 0;  // Frame counter of the camera
+	int dropped = 0;        // Frames dropped by the camera since the previous frame
+};
+
+// Monotonic clock in ns, the time base of FrameInfo::timestamp
+inline int64_t monotonic_ns() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// Difference between the real and the monotonic clock in ns, added to a
+// timestamp it gives the time since the epoch in UTC
+inline int64_t realtime_offset() {
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec - monotonic_ns();
+}
+
+// Histogram with power of two buckets in us, can be filled from the capture
+// thread while being read from another one
+class LatencyHistogram {
+public:
+	static const int BUCKETS = 32;
+
+	LatencyHistogram() {
+		reset();
+	}
+
+	void add(int64_t ns) {
+		int64_t us = ns / 1000;
+		int bucket = 0;
+		while (us > 0 && bucket < BUCKETS - 1) {
+			us >>= 1;
+			bucket ++;
+		}
+		m_buckets[bucket] ++;
+	}
+
+	void reset() {
+		for (int i = 0; i < BUCKETS; ++ i) {
+			m_buckets[i] = 0;
+		}
+	}
+
+	uint64_t count() const {
+		uint64_t total = 0;
+		for (int i = 0; i < BUCKETS; ++ i) {
+			total += m_buckets[i];
+		}
+		return total;
+	}
+
+	// Upper bound of the bucket that contains the given percentile in us
+	int64_t percentile(double p) const {
+		uint64_t total = count();
+		uint64_t sum = 0;
+
+		for (int i = 0; i < BUCKETS; ++ i) {
+			sum += m_buckets[i];
+			if (total > 0 && sum >= total * p / 100.0) {
+				return (1LL << i);
+			}
+		}
+
+		return 0;
+	}
+
+	std::string summary() const {
+		char buffer[100];
+		snprintf(buffer, sizeof(buffer), "n=%llu p50<%lldus p90<%lldus p99<%lldus",
+			(unsigned long long)count(), (long long)percentile(50), (long long)percentile(90), (long long)percentile(99));
+		return buffer;
+	}
+
+private:
+	std::atomic<uint64_t> m_buckets[BUCKETS];
+};
+
+#endif // FRAME_INFO_HPP
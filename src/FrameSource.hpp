@@ -0,0 +1,776 @@
+#ifndef FRAME_SOURCE_HPP
+#define FRAME_SOURCE_HPP
+
+#include "Image.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fitsio.h>
+#include <future>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define PREFETCH_FRAMES 16 // Decoded frames kept ahead of the replayed one by LazyDirectorySource
+#define PREFETCH_MAPPED 64 // Files mapped ahead of the replayed one if memory-mapped input is enabled
+
+// Recorded frames that are replayed by the VirtualCamera, in sequence order.
+// All frames have the size of the first one.
+class FrameSource {
+public:
+	virtual ~FrameSource() {}
+
+	virtual bool open() = 0;
+
+	// Number of frames, get is called with an index below it
+	virtual int size() = 0;
+
+	// Returns the frame with the given index or nullptr if it could not be
+	// read. The frame stays valid until the next call of get, views and the
+	// frames of persistent sources until close.
+	virtual const Image* get(int index) = 0;
+
+	virtual void close() = 0;
+
+	virtual bool is_persistent() {
+		return false;
+	}
+
+	// Recorded time of the frame in ns since the first one, -1 if the source
+	// has no timestamps
+	virtual int64_t get_timestamp(int index) {
+		return -1;
+	}
+
+	int get_width() const {
+		return m_width;
+	}
+
+	int get_height() const {
+		return m_height;
+	}
+
+protected:
+	int m_width = 0, m_height = 0;
+
+	// Decodes a file, returns nullptr and reports the error if that fails or
+	// if the frame has another size than the first one
+	Image* decode(const std::string& path) {
+		return check_size(load(path), path);
+	}
+
+	// Decodes a file, returns nullptr and reports the error if that fails.
+	// Can be called from any thread.
+	static Image* load(const std::string& path) {
+		try {
+			return new Image(path);
+		} catch (const std::runtime_error& e) {
+			std::cout << e.what() << std::endl;
+			return nullptr;
+		}
+	}
+
+	// The first frame determines the size, frames with another size are
+	// deleted and nullptr is returned
+	Image* check_size(Image* img, const std::string& path) {
+		if (img == nullptr) {
+			return nullptr;
+		}
+
+		if (m_width == 0) {
+			m_width = img->get_width();
+			m_height = img->get_height();
+		} else if (img->get_width() != m_width || img->get_height() != m_height) {
+			std::cout << "Skipping '" << path << "', size " << img->get_width() << "x" << img->get_height()
+				<< " differs from " << m_width << "x" << m_height << std::endl;
+			delete img;
+			return nullptr;
+		}
+
+		return img;
+	}
+
+	// Files of a directory sorted by name, hidden files are skipped
+	static bool list_directory(std::string path, std::vector<std::string>& files) {
+		struct dirent **namelist;
+		int n;
+
+		if (path[path.size()-1] != '\\' && path[path.size()-1] != '/') {
+			path += '/';
+		}
+
+		if ((n = scandir(path.c_str(), &namelist, 0, alphasort)) < 0) {
+			return false;
+		}
+
+		for (int i = 0; i < n; ++ i) {
+			if (namelist[i]->d_name[0] != '.') {
+				files.push_back(path + namelist[i]->d_name);
+			}
+			free(namelist[i]);
+		}
+		free(namelist);
+
+		return true;
+	}
+};
+
+// Decodes all images of a directory when it is opened. Needs memory for
+// every frame but replays without any disk access. The images are decoded in
+// parallel on the thread pool if one is given, the order stays the same.
+class EagerDirectorySource : public FrameSource {
+public:
+	EagerDirectorySource(const std::string& path, ThreadPool* pool = nullptr) : m_path(path), m_pool(pool) {}
+
+	~EagerDirectorySource() {
+		close();
+	}
+
+	bool open() {
+		std::vector<std::string> files;
+
+		close();
+		std::cout << "Loading images for virtual camera from folder: " << m_path << std::endl;
+
+		if (!list_directory(m_path, files)) {
+			return false;
+		}
+
+		std::vector<std::future<Image*>> decoded;
+		if (m_pool != nullptr) {
+			for (const std::string& file : files) {
+				decoded.push_back(m_pool->submit([file] {
+					return load(file);
+				}));
+			}
+		}
+
+		// Collects the frames in order, the size is checked here so that it is
+		// always compared against the first frame
+		int failed = 0;
+		int progress = 0;
+
+		for (int i = 0; i < files.size(); ++ i) {
+			Image* img = check_size(m_pool != nullptr ? decoded[i].get() : load(files[i]), files[i]);
+			if (img != nullptr) {
+				m_frames.push_back(img);
+			} else {
+				failed += 1;
+			}
+
+			if ((i + 1) * 10 / files.size() > progress) {
+				progress = (i + 1) * 10 / files.size();
+				std::cout << "Loaded " << (i + 1) << "/" << files.size() << " images" << std::endl;
+			}
+		}
+
+		if (m_frames.empty()) {
+			std::cout << "Directory empty, no images opened." << std::endl;
+			return false;
+		}
+
+		std::cout << "Finished loading " << m_frames.size() << " images, " << failed << " failed." << std::endl;
+		return true;
+	}
+
+	int size() {
+		return m_frames.size();
+	}
+
+	const Image* get(int index) {
+		return m_frames[index];
+	}
+
+	// All frames are kept in memory
+	bool is_persistent() {
+		return true;
+	}
+
+	void close() {
+		for (Image* img : m_frames) {
+			delete img;
+		}
+		m_frames.clear();
+		m_width = m_height = 0;
+	}
+
+private:
+	std::string m_path;
+	ThreadPool* m_pool;
+	std::vector<Image*> m_frames;
+};
+
+// Streams the images of a directory from disk. A prefetch thread decodes the
+// next PREFETCH_FRAMES frames after the one that was requested last and
+// evicts the ones behind it, so memory stays bounded for recordings of any
+// length and the replay starts as soon as the first frame is decoded.
+//
+// With memory-mapped input even more files ahead are mapped and the kernel is
+// asked to read them in the background, so decoding does not wait for the
+// disk.
+class LazyDirectorySource : public FrameSource {
+public:
+	LazyDirectorySource(const std::string& path, bool mapped = false) : m_path(path), m_mapped(mapped),
+		m_thread(nullptr), m_running(false), m_current(0) {}
+
+	~LazyDirectorySource() {
+		close();
+	}
+
+	bool open() {
+		close();
+		std::cout << "Streaming images for virtual camera from folder: " << m_path << std::endl;
+
+		if (!list_directory(m_path, m_files) || m_files.empty()) {
+			std::cout << "Directory empty, no images opened." << std::endl;
+			return false;
+		}
+
+		// The size of the frames is taken from the first readable one
+		for (int i = 0; i < m_files.size() && m_width == 0; ++ i) {
+			Image* img = decode(m_files[i]);
+			if (img != nullptr) {
+				m_current = i;
+				m_window[i] = img;
+			}
+		}
+
+		if (m_width == 0) {
+			return false;
+		}
+
+		std::cout << "Found " << m_files.size() << " images." << std::endl;
+
+		m_running = true;
+		m_thread = new std::thread(LazyDirectorySource::exec, this);
+
+		return true;
+	}
+
+	int size() {
+		return m_files.size();
+	}
+
+	// Waits until the prefetch thread decoded the frame, it is the first one
+	// that it decodes after the request
+	const Image* get(int index) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		m_current = index;
+		m_cond.notify_all();
+
+		m_cond.wait(lock, [this, index] {
+			return m_window.find(index) != m_window.end() || !m_running;
+		});
+
+		auto it = m_window.find(index);
+		return it == m_window.end() ? nullptr : it->second;
+	}
+
+	void close() {
+		if (m_thread != nullptr) {
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_running = false;
+			}
+			m_cond.notify_all();
+			m_thread->join();
+			delete m_thread;
+			m_thread = nullptr;
+		}
+
+		for (auto it = m_window.begin(); it != m_window.end(); ++ it) {
+			delete it->second;
+		}
+		m_window.clear();
+
+		for (auto it = m_maps.begin(); it != m_maps.end(); ++ it) {
+			munmap(it->second.first, it->second.second);
+		}
+		m_maps.clear();
+
+		m_files.clear();
+		m_width = m_height = 0;
+	}
+
+private:
+	std::string m_path;
+	bool m_mapped;
+	std::vector<std::string> m_files;
+
+	std::thread* m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	bool m_running;
+
+	int m_current; // Index of the frame that was requested last
+	std::map<int, Image*> m_window; // nullptr for files that could not be read
+	std::map<int, std::pair<void*, size_t>> m_maps; // Only used by the prefetch thread
+
+	// Distance of the frame after the current one, the replay wraps around
+	int ahead(int index) const {
+		int count = m_files.size();
+		return (index - m_current + count) % count;
+	}
+
+	// Maps the next PREFETCH_MAPPED files and unmaps the ones behind
+	void map_ahead() {
+		int current;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			current = m_current;
+		}
+
+		int files = m_files.size();
+		int count = std::min(PREFETCH_MAPPED, files);
+
+		for (auto it = m_maps.begin(); it != m_maps.end();) {
+			if ((it->first - current + files) % files >= count) {
+				munmap(it->second.first, it->second.second);
+				it = m_maps.erase(it);
+			} else {
+				++ it;
+			}
+		}
+
+		for (int i = 0; i < count; ++ i) {
+			int index = (current + i) % files;
+			if (m_maps.find(index) != m_maps.end()) {
+				continue;
+			}
+
+			struct stat st;
+			int fd = ::open(m_files[index].c_str(), O_RDONLY);
+			if (fd < 0) {
+				continue;
+			}
+
+			if (fstat(fd, &st) == 0 && st.st_size > 0) {
+				void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+				if (data != MAP_FAILED) {
+					madvise(data, st.st_size, MADV_WILLNEED);
+					m_maps[index] = std::make_pair(data, (size_t)st.st_size);
+				}
+			}
+			::close(fd);
+		}
+	}
+
+	static void exec(LazyDirectorySource* source) {
+		const int window = std::min<int>(PREFETCH_FRAMES, source->m_files.size());
+
+		for (;;) {
+			int index = -1;
+			{
+				std::unique_lock<std::mutex> lock(source->m_mutex);
+
+				// Waits until a frame of the window is missing
+				source->m_cond.wait(lock, [source, window, &index] {
+					for (int i = 0; i < window && source->m_running; ++ i) {
+						index = (source->m_current + i) % source->m_files.size();
+						if (source->m_window.find(index) == source->m_window.end()) {
+							return true;
+						}
+					}
+					return !source->m_running;
+				});
+
+				if (!source->m_running) {
+					return;
+				}
+
+				// Evicts frames behind the current one, it stays valid for the consumer
+				for (auto it = source->m_window.begin(); it != source->m_window.end();) {
+					if (source->ahead(it->first) >= window) {
+						delete it->second;
+						it = source->m_window.erase(it);
+					} else {
+						++ it;
+					}
+				}
+
+			}
+
+			if (source->m_mapped) {
+				source->map_ahead();
+			}
+
+			Image* img = source->decode(source->m_files[index]);
+
+			{
+				std::lock_guard<std::mutex> lock(source->m_mutex);
+				// The replay may have jumped while decoding
+				if (source->ahead(index) < window) {
+					source->m_window[index] = img;
+				} else {
+					delete img;
+				}
+			}
+			source->m_cond.notify_all();
+		}
+	}
+};
+
+// Whole file mapped read-only, the pages are read by the kernel on access
+class MappedFile {
+public:
+	MappedFile() : m_data(nullptr), m_size(0) {}
+
+	~MappedFile() {
+		close();
+	}
+
+	bool open(const std::string& path) {
+		struct stat st;
+
+		close();
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			std::cout << "Failed to open '" << path << "'" << std::endl;
+			return false;
+		}
+
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			if (data != MAP_FAILED) {
+				madvise(data, st.st_size, MADV_SEQUENTIAL);
+				m_data = (const uint8_t*)data;
+				m_size = st.st_size;
+			}
+		}
+		::close(fd);
+
+		return m_data != nullptr;
+	}
+
+	void close() {
+		if (m_data != nullptr) {
+			munmap((void*)m_data, m_size);
+			m_data = nullptr;
+			m_size = 0;
+		}
+	}
+
+	const uint8_t* data() const {
+		return m_data;
+	}
+
+	size_t size() const {
+		return m_size;
+	}
+
+private:
+	const uint8_t* m_data;
+	size_t m_size;
+};
+
+// Frames stored one after another in one memory mapped file. Frames with 8
+// bit mono pixels are returned as views into the mapping without any copy,
+// all other formats are converted to 8 bit gray on access. Pixels with more
+// than 8 bit are shifted down to 8 bit by the depth given in the header, many
+// capture tools store 12 or 14 bit data in 16 bit.
+class MappedSource : public FrameSource {
+public:
+	MappedSource(const std::string& path) : m_path(path) {}
+
+	int size() {
+		return m_offsets.size();
+	}
+
+	const Image* get(int index) {
+		const uint8_t* data = m_file.data() + m_offsets[index];
+
+		if (m_bytes == 1 && m_planes == 1 && m_zero == 0) {
+			m_frame.set_view(m_width, m_height, data);
+		} else {
+			convert(data, m_frame);
+		}
+
+		return &m_frame;
+	}
+
+	int64_t get_timestamp(int index) {
+		return index < (int)m_timestamps.size() ? m_timestamps[index] : -1;
+	}
+
+	void close() {
+		m_frame.set(0, 0);
+		m_file.close();
+		m_offsets.clear();
+		m_timestamps.clear();
+		m_width = m_height = 0;
+	}
+
+protected:
+	std::string m_path;
+	MappedFile m_file;
+	std::vector<size_t> m_offsets; // Offset of every frame in the file
+	std::vector<int64_t> m_timestamps; // Recorded time of every frame in ns since the first one, empty if there is none
+	int m_bytes = 1;          // Bytes per sample
+	int m_planes = 1;         // Color planes per pixel, 3 for RGB
+	bool m_bgr = false;       // Order of the color planes
+	bool m_big_endian = false;
+	bool m_signed = false;    // Samples are two's complement
+	int m_zero = 0;           // Added to every sample, BZERO of FITS
+	int m_depth = 0;          // Significant bits per sample from the header, 0 if unknown
+	int m_shift = 0;          // Bits the samples are shifted down by
+
+	// Checks the frames against the size of the file and picks the shift from
+	// the depth. Without a usable depth it is taken from the brightest pixel
+	// of the first frame.
+	bool finish_open() {
+		size_t frame_size = (size_t)m_width * m_height * m_bytes * m_planes;
+
+		while (!m_offsets.empty() && m_offsets.back() + frame_size > m_file.size()) {
+			m_offsets.pop_back();
+		}
+
+		if (m_offsets.empty()) {
+			std::cout << "No complete frame in '" << m_path << "'" << std::endl;
+			return false;
+		}
+
+		m_shift = 0;
+		if (m_bytes > 1 && m_depth > 8 && m_depth <= m_bytes * 8) {
+			m_shift = m_depth - 8;
+		} else if (m_bytes > 1) {
+			int max = 0;
+			const uint8_t* data = m_file.data() + m_offsets[0];
+			for (int i = 0; i < m_width * m_height * m_planes; ++ i) {
+				max = std::max(max, sample(data, i));
+			}
+			while ((max >> m_shift) > 255) {
+				m_shift ++;
+			}
+		}
+
+		std::cout << "Mapped " << m_offsets.size() << " frames of " << m_width << "x" << m_height
+			<< " with " << m_bytes * 8 << " bit from '" << m_path << "'" << std::endl;
+		return true;
+	}
+
+	int sample(const uint8_t* data, int i) const {
+		int value;
+		if (m_bytes == 1) {
+			value = m_signed ? (int8_t)data[i] : data[i];
+		} else {
+			const uint8_t* p = data + 2 * i;
+			uint16_t raw = m_big_endian ? (p[0] << 8 | p[1]) : (p[1] << 8 | p[0]);
+			value = m_signed ? (int16_t)raw : raw;
+		}
+		return std::max(value + m_zero, 0);
+	}
+
+	void convert(const uint8_t* data, Image& img) const {
+		if (img.get_width() != m_width || img.get_height() != m_height || img.is_view()) {
+			img.set(m_width, m_height);
+		}
+
+		for (int i = 0; i < m_width * m_height; ++ i) {
+			int value;
+			if (m_planes == 3) {
+				int r = sample(data, 3 * i + (m_bgr ? 2 : 0));
+				int g = sample(data, 3 * i + 1);
+				int b = sample(data, 3 * i + (m_bgr ? 0 : 2));
+				value = (77 * r + 150 * g + 29 * b) >> 8;
+			} else {
+				value = sample(data, i);
+			}
+			img.m_buffer[i] = std::min(value >> m_shift, 255);
+		}
+	}
+
+private:
+	Image m_frame; // Last returned frame, a view for 8 bit mono
+};
+
+// SER video as written by most planetary capture tools: a 178 byte header
+// followed by the frames and optionally their timestamps. Bayer frames are
+// replayed without debayering.
+class SerSource : public MappedSource {
+public:
+	SerSource(const std::string& path) : MappedSource(path) {}
+
+	~SerSource() {
+		close();
+	}
+
+	bool open() {
+		close();
+
+		if (!m_file.open(m_path)) {
+			return false;
+		}
+
+		const uint8_t* header = m_file.data();
+		if (m_file.size() < 178 || memcmp(header, "LUCAM-RECORDER", 14) != 0) {
+			std::cout << "'" << m_path << "' is not a SER file" << std::endl;
+			return false;
+		}
+
+		int color = read_int(header + 18);
+		int depth = read_int(header + 34);
+		int count = read_int(header + 38);
+
+		m_width = read_int(header + 26);
+		m_height = read_int(header + 30);
+		m_planes = color >= 100 ? 3 : 1;
+		m_bgr = color == 101;
+		m_bytes = depth > 8 ? 2 : 1;
+		m_depth = depth;
+
+		// The endianness flag is set the wrong way round by most writers,
+		// 16 bit samples are little endian in practice
+		m_big_endian = false;
+		m_signed = false;
+		m_zero = 0;
+
+		if (m_width <= 0 || m_height <= 0 || count <= 0) {
+			std::cout << "Invalid SER header in '" << m_path << "'" << std::endl;
+			return false;
+		}
+
+		size_t frame_size = (size_t)m_width * m_height * m_bytes * m_planes;
+		for (int i = 0; i < count; ++ i) {
+			m_offsets.push_back(178 + i * frame_size);
+		}
+
+		if (!finish_open()) {
+			return false;
+		}
+
+		read_timestamps(178 + count * frame_size, count);
+		return true;
+	}
+
+private:
+	static int read_int(const uint8_t* p) {
+		return p[0] | p[1] << 8 | p[2] << 16 | p[3] << 24;
+	}
+
+	static int64_t read_ticks(const uint8_t* p) {
+		return (int64_t)((uint64_t)(uint32_t)read_int(p) | (uint64_t)(uint32_t)read_int(p + 4) << 32);
+	}
+
+	// The optional trailer holds one time per frame in 100 ns ticks. It is
+	// only used if it is complete and does not run backwards, many writers
+	// leave it empty or fill it with zeros.
+	void read_timestamps(size_t offset, int count) {
+		if ((int)m_offsets.size() != count || offset + count * 8ULL > m_file.size()) {
+			return;
+		}
+
+		const uint8_t* data = m_file.data() + offset;
+		int64_t first = read_ticks(data);
+		if (first <= 0) {
+			return;
+		}
+
+		for (int i = 0; i < count; ++ i) {
+			int64_t ticks = read_ticks(data + 8 * i) - first;
+
+			if (ticks < 0 || (i > 0 && ticks * 100 < m_timestamps.back())) {
+				m_timestamps.clear();
+				return;
+			}
+			m_timestamps.push_back(ticks * 100);
+		}
+	}
+};
+
+// FITS file with one frame per image HDU, a 3-D cube or both. cfitsio finds
+// the data of every HDU, the data is then read from the mapping. HDUs with
+// another size or sample format than the first one are skipped, BSCALE is
+// assumed to be 1.
+class FitsCubeSource : public MappedSource {
+public:
+	FitsCubeSource(const std::string& path) : MappedSource(path) {}
+
+	~FitsCubeSource() {
+		close();
+	}
+
+	bool open() {
+		fitsfile* fptr;
+		int status = 0;
+		int hdus = 0;
+		int format = 0;
+
+		close();
+
+		if (fits_open_diskfile(&fptr, m_path.c_str(), READONLY, &status)) {
+			fits_report_error(stderr, status);
+			return false;
+		}
+
+		fits_get_num_hdus(fptr, &hdus, &status);
+
+		for (int hdu = 1; hdu <= hdus && status == 0; ++ hdu) {
+			int type, bitpix, naxis;
+			long naxes[3] = {0, 0, 1};
+			LONGLONG head, data, end;
+			double zero = 0;
+			int key_status = 0;
+
+			if (fits_movabs_hdu(fptr, hdu, &type, &status) || type != IMAGE_HDU
+				|| fits_get_img_param(fptr, 3, &bitpix, &naxis, naxes, &status) || naxis < 2
+				|| fits_get_hduaddrll(fptr, &head, &data, &end, &status)) {
+				continue;
+			}
+
+			fits_read_key(fptr, TDOUBLE, "BZERO", &zero, nullptr, &key_status);
+
+			if ((bitpix != 8 && bitpix != 16) || (format != 0 && (bitpix != format || naxes[0] != m_width || naxes[1] != m_height || (int)zero != m_zero))) {
+				std::cout << "Skipping HDU " << hdu << " of '" << m_path << "' with " << bitpix << " bit "
+					<< naxes[0] << "x" << naxes[1] << std::endl;
+				continue;
+			}
+
+			format = bitpix;
+			m_width = naxes[0];
+			m_height = naxes[1];
+			m_zero = zero;
+
+			for (long i = 0; i < (naxis > 2 ? naxes[2] : 1); ++ i) {
+				m_offsets.push_back(data + i * naxes[0] * naxes[1] * (bitpix / 8));
+			}
+		}
+
+		if (status != 0) {
+			fits_report_error(stderr, status);
+		}
+		status = 0;
+		fits_close_file(fptr, &status);
+
+		if (format == 0) {
+			std::cout << "No 8 or 16 bit image in '" << m_path << "'" << std::endl;
+			return false;
+		}
+
+		// FITS stores 16 bit as signed big endian, unsigned with a BZERO of 32768
+		m_bytes = format / 8;
+		m_planes = 1;
+		m_big_endian = true;
+		m_signed = format == 16;
+
+		// Unsigned 16 bit uses the full range, signed only the positive half
+		m_depth = format == 8 ? 8 : m_zero == 32768 ? 16 : m_zero == 0 ? 15 : 0;
+
+		return m_file.open(m_path) && finish_open();
+	}
+};
+
+#endif // FRAME_SOURCE_HPP
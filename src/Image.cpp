@@ -7,8 +7,11 @@
 
 #include "turbojpeg.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <ctime>
 #include <iostream>
 #include <string>
 #include <tiffio.h>
@@ -19,41 +22,121 @@ ErrorCode Image::open_tiff(const std::string &filepath) {
     return IMAGE_FILE_ERROR;
   }
 
-  TIFFRGBAImage img;
-  char emsg[1024];
+  // Grayscale files are read directly, everything else is converted by libtiff
+  ErrorCode code = read_tiff_gray(tif);
+  if (code == IMAGE_OTHER_ERROR) {
+    code = read_tiff_rgba(tif, filepath);
+  }
+
+  TIFFClose(tif);
+  return code;
+}
 
-  if (TIFFRGBAImageBegin(&img, tif, 0, emsg)) {
-    size_t npixels;
-    uint32_t *raster;
+// Reads 8 and 16 bit grayscale images strip by strip into the buffer, returns
+// IMAGE_OTHER_ERROR for all other formats without reading anything
+ErrorCode Image::read_tiff_gray(void *file) {
+  TIFF *tif = (TIFF *)file;
+  uint32_t width = 0, height = 0, rows = 0;
+  uint16_t bits = 0, samples = 0, photometric = 0, format = 0, orientation = 0;
+
+  TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+  TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+  TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bits);
+  TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &samples);
+  TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLEFORMAT, &format);
+  TIFFGetFieldDefaulted(tif, TIFFTAG_ORIENTATION, &orientation);
+  TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rows);
+  if (!TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &photometric)) {
+    return IMAGE_OTHER_ERROR;
+  }
 
-    m_height = img.height;
-    m_width = img.width;
+  bool gray = photometric == PHOTOMETRIC_MINISBLACK || photometric == PHOTOMETRIC_MINISWHITE;
+  if (!gray || samples != 1 || (bits != 8 && bits != 16) || format != SAMPLEFORMAT_UINT
+      || orientation != ORIENTATION_TOPLEFT || TIFFIsTiled(tif) || width == 0 || height == 0) {
+    return IMAGE_OTHER_ERROR;
+  }
 
-    npixels = img.width * img.height;
-    raster = (uint32_t *)_TIFFmalloc(npixels * sizeof(uint32_t));
-    if (raster != NULL) {
-      if (TIFFRGBAImageGet(&img, raster, img.width, img.height)) {
-        m_buffer = (uint8_t *)malloc(npixels);
+  set(width, height);
+  if (m_buffer == NULL) {
+    return IMAGE_ALLOC_ERROR;
+  }
 
-        for (int x = 0; x < m_width; ++ x) {
-          for (int y = 0; y < m_height; ++ y) {
-            m_buffer[x+y*m_width] = to_grayscale(raster[x+(m_height-1-y)*m_width]); // copy + invert y
-          }
-        }
+  rows = std::min(std::max<uint32_t>(rows, 1), height);
+  uint16_t *wide = NULL;
+  if (bits == 16) {
+    wide = (uint16_t *)_TIFFmalloc(TIFFStripSize(tif));
+    if (wide == NULL) {
+      return IMAGE_ALLOC_ERROR;
+    }
+  }
+
+  // 8 bit strips are decoded in place, 16 bit ones keep their upper byte
+  ErrorCode code = IMAGE_SUCCESS;
+  for (uint32_t strip = 0, y = 0; y < height; ++ strip, y += rows) {
+    size_t count = (size_t)std::min(rows, height - y) * width;
+    uint8_t *out = m_buffer + (size_t)y * width;
+
+    if (bits == 8) {
+      if (TIFFReadEncodedStrip(tif, strip, out, count) < (tmsize_t)count) {
+        code = IMAGE_FILE_ERROR;
+        break;
       }
-      _TIFFfree(raster);
     } else {
-      return IMAGE_ALLOC_ERROR;
+      if (TIFFReadEncodedStrip(tif, strip, wide, count * 2) < (tmsize_t)count * 2) {
+        code = IMAGE_FILE_ERROR;
+        break;
+      }
+      for (size_t i = 0; i < count; ++i) {
+        out[i] = wide[i] >> 8;
+      }
     }
-    TIFFRGBAImageEnd(&img);
-  } else {
+  }
+
+  if (wide != NULL) {
+    _TIFFfree(wide);
+  }
+
+  if (code == IMAGE_SUCCESS && photometric == PHOTOMETRIC_MINISWHITE) {
+    for (int i = 0; i < get_pixel_count(); ++i) {
+      m_buffer[i] = 255 - m_buffer[i];
+    }
+  }
+
+  return code;
+}
+
+// Lets libtiff convert any other format to RGBA, rows are requested top down
+// so that they match the buffer
+ErrorCode Image::read_tiff_rgba(void *file, const std::string &filepath) {
+  TIFF *tif = (TIFF *)file;
+  TIFFRGBAImage img;
+  char emsg[1024];
+
+  if (!TIFFRGBAImageBegin(&img, tif, 0, emsg)) {
     TIFFError(filepath.c_str(), "%s", emsg);
     return IMAGE_OTHER_ERROR;
   }
 
-  TIFFClose(tif);
+  img.req_orientation = ORIENTATION_TOPLEFT;
+  size_t npixels = (size_t)img.width * img.height;
+  uint32_t *raster = (uint32_t *)_TIFFmalloc(npixels * sizeof(uint32_t));
+  if (raster == NULL) {
+    TIFFRGBAImageEnd(&img);
+    return IMAGE_ALLOC_ERROR;
+  }
 
-  return IMAGE_SUCCESS;
+  ErrorCode code = IMAGE_OTHER_ERROR;
+  if (TIFFRGBAImageGet(&img, raster, img.width, img.height)) {
+    set(img.width, img.height);
+    for (size_t i = 0; i < npixels; ++i) {
+      m_buffer[i] = to_grayscale(raster[i]);
+    }
+    code = IMAGE_SUCCESS;
+  }
+
+  _TIFFfree(raster);
+  TIFFRGBAImageEnd(&img);
+  return code;
 }
 
 ErrorCode Image::save_tiff(const std::string &filepath) const {
@@ -85,43 +168,75 @@ ErrorCode Image::save_tiff(const std::string &filepath) const {
   return IMAGE_SUCCESS;
 }
 
-uint8_t Image::to_grayscale(int rgba) const {
-  int r = (rgba >> 16) & 0xFF;
-  int g = (rgba >> 8) & 0xFF;
-  int b = (rgba)&0xFF;
+void Image::get_subarea(Image &img, int sx, int sy, int width,
+                        int height) const {
+  img.set(width, height);
+
+  // Full rows are one block, otherwise every row is copied on its own
+  if (sx == 0 && width == m_width) {
+    std::memcpy(img.m_buffer, m_buffer + sy * m_width, (size_t)width * height);
+    return;
+  }
 
-  return 0.2989 * r + 0.5870 * g + 0.1140 * b;
+  for (int y = 0; y < height; ++y) {
+    std::memcpy(img.m_buffer + y * width, m_buffer + (sy + y) * m_width + sx, width);
+  }
 }
 
-void Image::get_subarea(Image &img, int sx, int sy, int width,
-                        int height) const {
+// Averages blocks of bin x bin pixels, remaining rows and columns are cut off
+void Image::get_binned(Image &img, int bin) const {
+  int width = m_width / bin;
+  int height = m_height / bin;
+
   img.set(width, height);
 
-  for (int x = 0; x < width; ++x) {
-    for (int y = 0; y < height; ++y) {
-      img.get_pixel(x, y) = get_pixel(sx + x, sy + y);
+  for (int y = 0; y < height; ++y) {
+    uint8_t *out = img.m_buffer + y * width;
+
+    for (int x = 0; x < width; ++x) {
+      int sum = 0;
+      for (int by = 0; by < bin; ++by) {
+        const uint8_t *row = m_buffer + (y * bin + by) * m_width + x * bin;
+        for (int bx = 0; bx < bin; ++bx) {
+          sum += row[bx];
+        }
+      }
+      out[x] = sum / (bin * bin);
     }
   }
 }
 
 void Image::set(int width, int height) {
-  if (m_buffer) {
+  if (m_buffer && m_owner) {
     free(m_buffer);
   }
 
   m_width = width;
   m_height = height;
   m_buffer = (uint8_t *)malloc(get_pixel_count());
+  m_owner = true;
 }
 
 void Image::set(int width, int height, uint8_t *buffer) {
-  if (m_buffer) {
+  if (m_buffer && m_owner) {
     free(m_buffer);
   }
 
   m_width = width;
   m_height = height;
   m_buffer = buffer;
+  m_owner = true;
+}
+
+void Image::set_view(int width, int height, const uint8_t *buffer) {
+  if (m_buffer && m_owner) {
+    free(m_buffer);
+  }
+
+  m_width = width;
+  m_height = height;
+  m_buffer = const_cast<uint8_t *>(buffer);
+  m_owner = false;
 }
 
 uint8_t Image::get_pixel(int x, int y) const {
@@ -163,26 +278,98 @@ void Image::write_func(std::string *img, void *data, int size) {
   }
 }
 
-void Image::save_fits(const char *filename) const {
-  remove(filename); // Delete existing file with that name
+// ISO 8601 time with milliseconds of a time in ns since the epoch
+static void format_fits_date(char *date, size_t size, int64_t utc) {
+  time_t seconds = utc / 1000000000LL;
+  struct tm tm;
+  gmtime_r(&seconds, &tm);
+
+  int length = strftime(date, size, "%Y-%m-%dT%H:%M:%S", &tm);
+  snprintf(date + length, size - length, ".%03d", (int)(utc / 1000000 % 1000));
+}
+
+// Creates the image HDU in an empty file, the file is not closed
+bool Image::write_fits(void *file, const FitsHeader &header, int &status) const {
+  fitsfile *fptr = (fitsfile *)file;
+  long naxes[2] = {m_width, m_height};
+
+  fits_create_img(fptr, BYTE_IMG, 2, naxes, &status);
+
+  if (header.exposure > 0) {
+    double exptime = header.exposure * 1e-6;
+    fits_update_key(fptr, TDOUBLE, "EXPTIME", &exptime, "Exposure time in seconds", &status);
+  }
+
+  int gain = header.gain;
+  fits_update_key(fptr, TINT, "GAIN", &gain, "Camera gain", &status);
+
+  // DATE-OBS is the start of the exposure, DATE-END its end
+  if (header.utc != 0) {
+    char date[32];
+    format_fits_date(date, sizeof(date), header.utc - header.exposure * 1000LL);
+    fits_update_key(fptr, TSTRING, "DATE-OBS", date, "UTC start of exposure", &status);
+    format_fits_date(date, sizeof(date), header.utc);
+    fits_update_key(fptr, TSTRING, "DATE-END", date, "UTC end of exposure", &status);
+  }
 
-  fitsfile *fptr; // Pointer to the FITS file
-  int ii, jj;
-  long fpixel = 1, naxis = 2, nelements, exposure;
-  long naxes[2] = {m_width, m_height}; // Size of image
+  int bin = header.bin;
+  fits_update_key(fptr, TINT, "XBINNING", &bin, "Binning factor in width", &status);
+  fits_update_key(fptr, TINT, "YBINNING", &bin, "Binning factor in height", &status);
+
+  if (header.plate_scale > 0) {
+    double scale = header.plate_scale * header.bin;
+    fits_update_key(fptr, TDOUBLE, "SECPIX1", &scale, "Arcsec per pixel", &status);
+    fits_update_key(fptr, TDOUBLE, "SECPIX2", &scale, "Arcsec per pixel", &status);
+  }
+
+  if (!header.instrument.empty()) {
+    char instrument[FLEN_VALUE];
+    snprintf(instrument, sizeof(instrument), "%s", header.instrument.c_str());
+    fits_update_key(fptr, TSTRING, "INSTRUME", instrument, "Camera", &status);
+  }
+
+  fits_write_date(fptr, &status);
+  fits_write_img(fptr, TBYTE, 1, get_pixel_count(), m_buffer, &status);
+
+  return status == 0;
+}
+
+bool Image::save_fits(const std::string &filename, const FitsHeader &header) const {
+  fitsfile *fptr;
+  int status = 0;
+
+  // A leading ! makes cfitsio replace an existing file
+  if (fits_create_file(&fptr, ("!" + filename).c_str(), &status) == 0) {
+    write_fits(fptr, header, status);
+    fits_close_file(fptr, &status);
+  }
+
+  fits_report_error(stderr, status);
+  return status == 0;
+}
+
+std::string Image::encode_fits(const FitsHeader &header) const {
+  fitsfile *fptr;
   int status = 0;
-  
-  // Create new file
-  fits_create_file(&fptr, filename, &status); 
-  fits_create_img(fptr, SHORT_IMG, naxis, naxes, &status);
-  
-  // Number of pixels to write
-  nelements = naxes[0] * naxes[1]; 
-
-  // Write the array of integers to the image
-  fits_write_img(fptr, TBYTE, fpixel, nelements, m_buffer, &status);
-
-  // Close file and print error msg if present
-  fits_close_file(fptr, &status);
+  LONGLONG start, data, end = 0;
+
+  // Header and data are padded to blocks of 2880 bytes, cfitsio grows the
+  // buffer with realloc if it is too small
+  size_t size = 2880 * (2 + get_pixel_count() / 2880 + 1);
+  void *memory = malloc(size);
+
+  if (fits_create_memfile(&fptr, &memory, &size, 2880, realloc, &status) == 0) {
+    write_fits(fptr, header, status);
+    fits_get_hduaddrll(fptr, &start, &data, &end, &status);
+    fits_close_file(fptr, &status);
+  }
+
+  std::string buffer;
+  if (status == 0) {
+    buffer.assign((const char *)memory, std::min<size_t>((end + 2879) / 2880 * 2880, size));
+  }
+
   fits_report_error(stderr, status);
+  free(memory);
+  return buffer;
 }
@@ -16,6 +16,17 @@ enum ErrorCode {
   IMAGE_OTHER_ERROR,
 };
 
+// Keywords written with a FITS image. Exposure, time and plate scale are left
+// out when they are zero, gain and binning are always written.
+struct FitsHeader {
+  int exposure = 0;        // Exposure time in us
+  int gain = 0;
+  int64_t utc = 0;         // End of the exposure in ns since the epoch
+  int bin = 1;
+  double plate_scale = 0;  // Arcsec per unbinned pixel
+  std::string instrument;
+};
+
 class Image {
 public:
   uint8_t *m_buffer;
@@ -42,19 +53,20 @@ public:
   }
 
   ~Image() {
-    if (m_buffer) {
+    if (m_buffer && m_owner) {
       free(m_buffer);
     }
   }
 
   void copy_from(const Image &img) {
-    if (m_buffer) {
+    if (m_buffer && m_owner) {
       free(m_buffer);
     }
 
     m_width = img.m_width;
     m_height = img.m_height;
     m_buffer = (uint8_t *)malloc(get_pixel_count());
+    m_owner = true;
 
     std::memcpy(m_buffer, img.m_buffer, get_pixel_count());
   }
@@ -67,8 +79,17 @@ public:
 
   void set(int width, int height);
 
+  // Refers to pixels owned by someone else, e.g. a memory mapped file, they
+  // are not freed with the image. The pixels may be read-only, a view must
+  // only be read until set or copy_from gives it its own buffer again.
+  void set_view(int width, int height, const uint8_t *buffer);
+
+  bool is_view() const { return !m_owner; }
+
   void get_subarea(Image &img, int sx, int sy, int width, int height) const;
 
+  void get_binned(Image &img, int bin) const;
+
   std::string get_encoded_str(int quality) const;
 
   int get_width() const { return m_width; }
@@ -80,14 +101,33 @@ public:
   uint8_t get_pixel(int x, int y) const;
   uint8_t& get_pixel(int x, int y);
 
-  void save_fits(const char *filename) const;
+  // Writes an 8 bit FITS file, an existing file is replaced
+  bool save_fits(const std::string &filename, const FitsHeader &header = FitsHeader()) const;
+
+  // Same as save_fits but into memory, returns an empty string on failure
+  std::string encode_fits(const FitsHeader &header = FitsHeader()) const;
 
 private:
   int m_width, m_height;
+  bool m_owner = true; // m_buffer is freed with the image
 
-  uint8_t to_grayscale(int rgba) const;
+  ErrorCode read_tiff_gray(void *file);
+
+  ErrorCode read_tiff_rgba(void *file, const std::string &filepath);
+
+  // Luminance of a libtiff ABGR pixel with integer weights that sum to 256,
+  // so that the conversion loop vectorizes
+  static uint8_t to_grayscale(uint32_t abgr) {
+    uint32_t r = abgr & 0xFF;
+    uint32_t g = (abgr >> 8) & 0xFF;
+    uint32_t b = (abgr >> 16) & 0xFF;
+
+    return (77 * r + 150 * g + 29 * b) >> 8;
+  }
 
   static void write_func(std::string *img, void *data, int size);
+
+  bool write_fits(void *file, const FitsHeader &header, int &status) const;
 };
 
 #endif // IMAGE_HPP
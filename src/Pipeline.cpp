@@ -0,0 +1,666 @@
+#include "Pipeline.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <locale>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define ASTAP_PROGRAM "/home/daniel/Documents/Diploma/astap_command-line_version_Linux_amd64/astap_cli"
+#define ASTAP_DATABASE "/home/daniel/Documents/Diploma/astap_command-line_version_Linux_amd64/h18"
+
+#define CENTROID_FAILURES 10 // Invalid centroids in a row that dump the flight recorder
+
+// Helper definitions that convert from radians to degrees and vice versa
+#define rad(deg) ((deg)*(M_PI/180.0))
+#define deg(rad) ((rad)*(180.0/M_PI))
+
+/**
+ * This function calculates the azimuth and altitude of a celestial body given its right ascension, declination,
+ * and the latitude and local mean sidereal time at the observer's location.
+ *
+ * Parameters:
+ *  lmst: Local mean sidereal time at the observer's location in degrees.
+ *  rightAscension: Right ascension of the celestial body in degrees.
+ *  declination: Declination of the celestial body in degrees.
+ *  latitude: Latitude of the observer's location in degrees.
+ *  azimuth: Output parameter for the calculated azimuth in degrees.
+ *  altitude: Output parameter for the calculated altitude in degrees.
+ */
+static void get_azimut_and_height(double lmst, double rightAscension, double declination, double latitude, double& azimuth, double& altitude) {
+  double phi = rad(latitude);
+  double tau = rad(15 * (lmst - rightAscension));
+  double delta = rad(declination);
+
+  azimuth = deg(atan(sin(tau)/(sin(phi)*cos(tau)-cos(phi)*tan(delta))));
+  altitude = deg(asin(sin(phi)*sin(delta) + cos(phi)*cos(delta)*cos(tau)));
+}
+
+/*
+ * Returns false if star is to close to the edge of the image, because this
+ * can cause issues since the algorithm would look for pixels outside of
+ * the bounds, which could lead to crashes or undefined beahviour.
+ */
+static bool is_star_outside_box(const Image& img, StarInfo& star, int area) {
+	int space = area/2;
+	bool bottomright = star.x() > img.get_width() - space || star.y() > img.get_height() - space;
+	bool topleft = star.x() < space || star.y() < space;
+
+	return bottomright || topleft;
+}
+
+struct Comma final : std::numpunct<char> {
+    char do_decimal_point() const override { return ','; }
+};
+
+Pipeline::Pipeline(int index, Camera* camera, Settings* settings, WebServer* server, SerialManager* serial, ThreadPool* pool)
+	: m_index(index), m_camera(new AsyncCamera(camera)), m_settings(settings), m_server(server), m_serial(serial), m_pool(pool),
+	  m_bandwidth_tuner(nullptr), m_flight_recorder(FLIGHT_RECORDER_SIZE, FLIGHT_RECORDER_FRAMES), m_thread(nullptr), m_running(false) {}
+
+Pipeline::~Pipeline() {
+	stop();
+	delete m_bandwidth_tuner;
+	delete m_camera;
+}
+
+bool Pipeline::open() {
+	if (!m_camera->open()) {
+		return false;
+	}
+
+	// Start with the bandwidth that was tuned for this camera before
+	BandwidthTuner* tuner = new BandwidthTuner(m_camera->get_name(), m_camera->get_serial());
+	if (m_camera->set_bandwidth(tuner->get_bandwidth(), tuner->get_high_speed())) {
+		m_bandwidth_tuner = tuner;
+	} else {
+		delete tuner;
+	}
+
+	// Get camera resolution
+	int width, height;
+	m_camera->get_fullsize(width, height);
+	std::cout << "Camera " << m_index << " resolution: " << width << "x" << height << std::endl;
+
+	m_exposure_control.reset(m_settings->get<OptionNumber>("exposure")->get() * 1000, m_settings->get<OptionNumber>("gain")->get());
+
+	return true;
+}
+
+void Pipeline::run() {
+	m_running = true;
+	m_thread = new std::thread(Pipeline::exec, this);
+}
+
+void Pipeline::stop() {
+	if (m_thread != nullptr) {
+		m_running = false;
+		m_thread->join();
+		delete m_thread;
+		m_thread = nullptr;
+	}
+}
+
+void Pipeline::close() {
+	m_camera->close();
+}
+
+void Pipeline::exec(Pipeline* pipeline) {
+	pipeline->loop();
+}
+
+SeeingResult Pipeline::measure_star(Image& frame, const StarInfo& star, int area) {
+	const int measurements = m_settings->get<OptionNumber>("measurements")->get();
+	const int measure_mode = m_settings->get<OptionMode>("measure_mode")->get();
+	const int min_valid = m_settings->get<OptionNumber>("min_valid")->get();
+	const bool adaptive = m_settings->get<OptionBool>("adaptive")->get();
+	const int min_measurements = std::min<int>(m_settings->get<OptionNumber>("min_measurements")->get(), measurements);
+	const double precision = m_settings->get<OptionNumber>("precision")->get() / 100.0;
+
+	std::vector<Image> frames;
+	CentroidSeries series;
+	BurstConvergence convergence(precision);
+
+	const bool follow_drift = m_settings->get<OptionBool>("follow_drift")->get();
+
+	// Every frame of the burst is recorded for offline analysis if enabled
+	const bool record = m_settings->get<OptionBool>("record_bursts")->get();
+	SerRecorder recorder;
+
+	// The recent frames are kept in memory to look at them after a failure
+	m_flight_recorder.set_seconds(m_settings->get<OptionNumber>("flight_seconds")->get());
+	int failures = 0;
+
+	int width, height;
+	m_camera->get_fullsize(width, height);
+
+	// Set region of interest
+	int roi_x = star.x()-area/2.0;
+	int roi_y = star.y()-area/2.0;
+	m_camera->set_roi(roi_x, roi_y, area, area);
+
+	// Start capturing data, the centroids are calculated while capturing so
+	// that an adaptive burst can stop as soon as the estimate has converged.
+	// Frames dropped by the camera or skipped by the capture thread show up as
+	// gaps in the frame index. Cameras that only count dropped frames in
+	// total are asked once before and once after the burst.
+	FrameInfo info, first;
+	int64_t first_utc = 0;
+	int dropped = 0;
+	m_camera->start_capture();
+	m_camera->get_latency().reset();
+	const int dropped_before = m_camera->get_dropped_frames();
+	for (int i = 0; i < measurements && m_running; ++ i) {
+		Image img;
+		if (!m_camera->get_data(img, &info)) {
+			std::cout << "Failed to capture frame " << i << std::endl;
+			continue;
+		}
+		frames.push_back(img);
+		m_flight_recorder.add(img, info);
+
+		// The header is built once per burst, only the time changes between
+		// the frames
+		if (frames.size() == 1) {
+			first = info;
+			set_header(first);
+			first_utc = m_header.utc;
+			if (record) {
+				recorder.open(recording_filename("BU") + ".ser", img.get_width(), img.get_height(), m_camera->get_name(), measurements);
+			}
+		} else {
+			dropped += info.dropped;
+			m_header.utc = first_utc != 0 ? first_utc + info.timestamp - first.timestamp : 0;
+			m_server->setImageHeader(m_index, m_header);
+		}
+
+		if (recorder.is_open()) {
+			recorder.add(img, info);
+		}
+
+		// Centroids are stored in full frame coordinates, so that they stay
+		// continuous when the ROI is moved
+		double t = (info.timestamp - first.timestamp) * 1e-9;
+		CentroidSample sample = calculate_centroid_sample(img, info.sequence - first.sequence + dropped, t);
+		sample.x += info.roi_x;
+		sample.y += info.roi_y;
+		series.push_back(sample);
+		convergence.add(sample);
+
+		failures = sample.valid ? 0 : failures + 1;
+		if (failures == CENTROID_FAILURES) {
+			dump_recent("centroid failed on " + std::to_string(failures) + " frames in a row");
+		}
+
+		// Re-centre the ROI on the star once it leaves the central half of the
+		// ROI, the start position can be moved without restarting the capture
+		double offset_x = sample.x - (info.roi_x + area/2.0);
+		double offset_y = sample.y - (info.roi_y + area/2.0);
+		if (follow_drift && sample.valid && (std::abs(offset_x) > area/4.0 || std::abs(offset_y) > area/4.0)) {
+			roi_x = std::min(std::max<int>(sample.x - area/2.0, 0), width - area);
+			roi_y = std::min(std::max<int>(sample.y - area/2.0, 0), height - area);
+			m_camera->set_roi(roi_x, roi_y, area, area);
+			printf("Star drifted by %0.1f, %0.1f px, moved ROI to %d, %d\n", offset_x, offset_y, roi_x, roi_y);
+		}
+
+	    m_server->applyData(m_index, img, "Capturing Frame " + std::to_string(i) + " of " + std::to_string(measurements), {}, true);
+
+		if (adaptive && i + 1 >= min_measurements && convergence.converged()) {
+			printf("Burst converged after %d frames, relative error %0.2f%%\n", i + 1, convergence.relative_error() * 100);
+			break;
+		}
+	}
+	dropped = std::max(m_camera->get_dropped_frames() - dropped_before, dropped);
+	std::cout << "Captured frames, dropped: " << dropped << ", latency: " << m_camera->get_latency().summary() << std::endl;
+	recorder.close();
+
+	// The frame rate the camera delivered during the burst tunes the USB
+	// bandwidth for the next one, frames skipped by the capture thread are
+	// part of the delivered frames
+	double duration = (info.timestamp - first.timestamp) * 1e-9;
+	if (m_bandwidth_tuner != nullptr && m_settings->get<OptionBool>("auto_bandwidth")->get() && frames.size() > 1) {
+		if (m_bandwidth_tuner->report(info.sequence - first.sequence, dropped, duration)) {
+			m_camera->set_bandwidth(m_bandwidth_tuner->get_bandwidth(), m_bandwidth_tuner->get_high_speed());
+		}
+	}
+
+	if (frames.empty()) {
+		return SeeingResult();
+	}
+
+	// Exclude bad frames instead of discarding the whole burst, the result is
+	// only rejected if too few frames are left
+	SeeingResult result;
+	int rejected = sigma_clip_series(series, 5.0);
+	result.valid_fraction = valid_fraction(series);
+	printf("Sigma clipping rejected %d frames, %0.1f%% valid\n", rejected, result.valid_fraction * 100);
+
+	if (result.valid_fraction * 100 < min_valid) {
+		printf("Too few valid frames, minimum is %d%%\n", min_valid);
+		dump_recent("burst rejected with " + std::to_string((int)(result.valid_fraction * 100)) + "% valid frames");
+		frame.copy_from(frames.back());
+		return result;
+	}
+
+	// The estimators are independent of each other, they run in parallel on
+	// the shared pool while this pipeline waits for them
+	std::future<double> tau0 = m_pool->submit([&series] { return calculate_coherence_time(series); });
+	std::future<double> scintillation = m_pool->submit([&series] { return calculate_scintillation(series); });
+	std::future<double> seeing = m_pool->submit([&] {
+		// Calculating seeing from frames
+		switch (measure_mode) {
+		case M_AVERAGE:
+			// The scatter is summed over all frames, scale a burst that stopped early
+			// to the configured length so that the values stay comparable
+			return calculate_seeing_average(series) * std::sqrt(measurements / (double)frames.size());
+		case M_CORRELATION:
+			return calculate_seeing_correlation(series);
+		case M_FWHM:
+			return calculate_seeing_fwhm(frames);
+		default:
+			return 0.0;
+		}
+	});
+
+	result.seeing = seeing.get();
+	result.tau0 = tau0.get();
+	result.scintillation = scintillation.get();
+	printf("Took %zu images and calculated: seeing = %0.4f, tau0 = %0.2fms, scintillation = %0.4f\n", frames.size(), result.seeing, result.tau0, result.scintillation);
+
+	// Return latest frame for displaying in webinterface
+	frame.copy_from(frames.back());
+
+	return result;
+}
+
+// Lets the exposure controller adjust gain and exposure on the frames of the
+// current ROI, returns true once the peak of the star is close to the target
+bool Pipeline::settle_exposure(int frames) {
+	Image frame;
+
+	for (int i = 0; i < frames; ++ i) {
+		if (!m_camera->get_data(frame)) {
+			return false;
+		}
+
+		if (m_exposure_control.update(frame)) {
+			return true;
+		}
+
+		m_camera->set_exposure(m_exposure_control.get_exposure());
+		m_camera->set_gain(m_exposure_control.get_gain());
+	}
+
+	printf("Exposure not settled, peak: %d, background: %d, exposure: %dus, gain: %d\n",
+		m_exposure_control.get_peak(), m_exposure_control.get_background(), m_exposure_control.get_exposure(), m_exposure_control.get_gain());
+	return false;
+}
+
+bool Pipeline::astap_solve(double& ra, double& dc) {
+	std::string buffer;
+	std::string fits = "temp" + suffix() + ".fits";
+	std::string ini = "temp" + suffix() + ".ini";
+
+	// The request comes from the webinterface, it waits for the file but the
+	// capture keeps running meanwhile
+	Image image;
+	FitsHeader header;
+	m_server->getCurrentDisplayed(m_index, image, header);
+	std::future<bool> saved = m_fits_writer.save(image, header, fits);
+	if (!saved.get()) {
+		std::cout << "Failed to save " << fits << " for ASTAP" << std::endl;
+		return false;
+	}
+	std::cout << "Saved " << fits << " for ASTAP and starting ASTAP" << std::endl;
+
+	// Every pipeline can run ASTAP, only its own child is waited for
+	pid_t pid = fork();
+	if (pid < 0) {
+		std::cout << "Failed to start ASTAP" << std::endl;
+		return false;
+	} else if (pid == 0) {
+		// runs command: ./astap_cli -d h18 -f file.fits -ra 3h -spd 180 -s 50 -m 4
+		execlp(ASTAP_PROGRAM, "astap", "-f", fits.c_str(), "-d", ASTAP_DATABASE, "-ra", "3h", "-spd", "180", "-s", "50", nullptr);
+		// The copy of the process must not return into the pipeline
+		_exit(127);
+	} else {
+		waitpid(pid, nullptr, 0);
+		std::cout << "ASTAP process finished" << std::endl;
+		std::ifstream file(ini);
+		if (!file.is_open()) {
+			std::cout << "No " << ini << " file found!" << std::endl;
+			return false;
+		}
+
+		// Check if platesolving was successful
+		goToLine(file, 2);
+		file >> buffer;
+		if (buffer.compare("PLTSOLVD=F") == 0) {
+			std::cout << "ASTAP exited with error" << std::endl;
+			file.close();
+			return false;
+		}
+
+		goToLine(file, 4);
+		file.seekg(8, std::ios::cur);
+		file >> ra;
+
+		goToLine(file, 5);
+		file.seekg(8, std::ios::cur);
+		file >> dc;
+
+		file.close();
+
+		std::cout << "Extracted ra: " << ra << " and dc: " << dc << std::endl;
+
+		// Convert to different format
+		ra = (24.0 / 360.0) * ra;
+	}
+
+	return true;
+}
+
+std::string Pipeline::btn_platesolving() {
+	double rightAscension, declination;
+	if (!astap_solve(rightAscension, declination)) {
+		return "Failed to solve image";
+	}
+
+	double longitude = m_settings->get<OptionNumber>("longitude")->get();
+	double latitude = m_settings->get<OptionNumber>("latitude")->get();
+	double lmst = get_siderial_time(longitude);
+
+	// Current image center
+	double azimuth, altitude;
+	get_azimut_and_height(lmst, rightAscension, declination, latitude, azimuth, altitude);
+
+	// Difference in pixel
+	double degPerPx = m_settings->get<OptionNumber>("deg_per_px")->get() / 3600.0;
+	double diffX = (azimuth-0)/degPerPx;
+	double diffY = (altitude-latitude)/degPerPx;
+
+	m_server->setPlateSolveData(m_index, diffX, diffY);
+
+	std::stringstream ss;
+
+	ss << "rekta: " << rightAscension << std::endl;
+	ss << "dekli: " << declination << std::endl;
+	ss << "delta azimuth: " << azimuth << std::endl;
+	ss << "delta altitude: " << (altitude-latitude) << std::endl;
+
+	return ss.str();
+}
+
+std::string Pipeline::btn_dump() {
+	if (!dump_recent("requested in the webinterface")) {
+		return "No frames recorded or still writing the previous ones";
+	}
+	return "Writing recent frames to ./recordings";
+}
+
+// Recordings are stored in ./recordings, named after the time they started
+// without extension
+std::string Pipeline::recording_filename(const std::string& prefix) {
+	auto t = std::time(nullptr);
+	auto tm = *std::localtime(&t);
+
+	std::ostringstream name;
+	name << "./recordings/" << prefix << std::put_time(&tm, "%y%m%d_%H%M%S") << suffix();
+
+	mkdir("./recordings", 0755);
+	return name.str();
+}
+
+// Writes the frames of the flight recorder in the background
+bool Pipeline::dump_recent(const std::string& reason) {
+	return m_flight_recorder.dump(recording_filename("FR"), reason, m_camera->get_name());
+}
+
+void Pipeline::set_header(const FrameInfo& info) {
+	m_header = FitsWriter::make_header(info, m_settings->get<OptionNumber>("deg_per_px")->get(), m_camera->get_name());
+	m_server->setImageHeader(m_index, m_header);
+}
+
+bool Pipeline::store_seeing(const SeeingResult& result) {
+	auto t = std::time(nullptr);
+    auto tm = *std::localtime(&t);
+
+    std::ostringstream date, time;
+    date << std::put_time(&tm, "%y%m%d");
+    time << std::put_time(&tm, "%H:%M");
+
+	std::ofstream out("./measurements/SE" + date.str() + suffix() + ".dat", std::ios_base::app);
+    out.imbue(std::locale(std::locale::classic(), new Comma));
+
+	if (!out.is_open()) {
+		return false;
+	}
+
+	char data[80];
+	int len = sprintf(data, "%s\t%.2f\t%.2f\t%.4f\r\n", time.str().c_str(), result.seeing, result.tau0, result.scintillation);
+
+	out.write(data, len);
+	out.close();
+
+	return true;
+}
+
+void Pipeline::loop() {
+	// Get camera resolution
+	int width, height;
+	m_camera->get_fullsize(width, height);
+
+	// Temporary variables
+	std::stringstream status;
+	std::vector<StarInfo> stars;
+	Image img;
+
+    auto lastTime = std::chrono::high_resolution_clock::now();
+
+	// Start main loop
+	while (m_running) {
+		stars.clear();
+		status.str("");
+		status.clear();
+
+		// Get settings
+		const int star_size_min = m_settings->get<OptionNumber>("star_size")->get();
+		const int capture_mode = m_settings->get<OptionMode>("capture_mode")->get();
+		const int show_threshold = m_settings->get<OptionBool>("v_threshold")->get();
+		const int min_threshold = m_settings->get<OptionNumber>("min_threshold")->get();
+		const int exposure = m_settings->get<OptionNumber>("exposure")->get() * 1000; // stored as ms but used as us
+		const int gain = m_settings->get<OptionNumber>("gain")->get();
+		const int area = m_settings->get<OptionNumber>("roi")->get();
+		const int search_bin = m_settings->get<OptionMode>("search_bin")->get() + 1;
+		const bool auto_exposure = m_settings->get<OptionBool>("auto_exposure")->get();
+
+		m_exposure_control.set_limits(exposure, gain);
+		m_exposure_control.set_target(m_settings->get<OptionNumber>("target_peak")->get());
+
+		const auto nowTime = std::chrono::high_resolution_clock::now();
+
+		if (!m_server->hasClient(m_index) && capture_mode == C_SEARCH) {
+			if (m_camera->is_capturing()) {
+				m_camera->stop_capture();
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			continue;
+		}
+
+		// Search mode only shows the overlays, so binned frames are good enough
+		// there. Falls back to no binning if the camera does not support it.
+		if (!m_camera->set_bin(capture_mode == C_SEARCH ? search_bin : 1)) {
+			m_camera->set_bin(1);
+		}
+		const int bin = m_camera->get_bin();
+
+		m_camera->set_roi(0, 0, width, height);
+		m_camera->set_exposure(exposure);
+		m_camera->set_gain(gain);
+		m_server->setBinning(m_index, bin);
+
+
+		// Find biggest star, the capture keeps running so that the next frame
+		// is already exposed while this one is processed
+		FrameInfo info;
+		m_camera->start_capture();
+		m_camera->get_data(img, &info);
+		set_header(info);
+
+		status << "Master frame: " << m_camera->get_frame() << std::endl;
+		if (m_camera->get_recoveries() > 0) {
+			status << "Camera recoveries: " << m_camera->get_recoveries() << std::endl;
+		}
+
+		const int threshold = std::max(calculate_threshold(img), min_threshold);
+		status << "Threshold: " << threshold << std::endl;
+
+		const int count = findStars(img, stars, threshold, std::max(1, star_size_min / (bin*bin)));
+		status << "Star count: " << count << std::endl;
+
+		// Star coordinates are always in unbinned pixels
+		for (StarInfo& star : stars) {
+			star = star.scaled(bin);
+		}
+
+		if (show_threshold && capture_mode == C_SEARCH) {
+			visualize_threshold(img, threshold);
+		}
+
+		// In case no stars were found, retry
+		if (count <= 0) {
+			m_server->applyData(m_index, img, status.str(), stars, false);
+
+			if (nowTime > lastTime + std::chrono::seconds(10)) {
+				printf("Camera %d found %d stars with threshold %d\n", m_index, count, threshold);
+				printf("Master frame: %d\n", m_camera->get_frame());
+				lastTime = nowTime;
+			}
+
+			continue;
+		}
+
+		// Sort stars, first element is the biggest star
+		std::sort(stars.begin(), stars.end(), sort_stars);
+
+		status << "Brightest star: [ x:" << stars[0].x() << ", y:" << stars[0].y() << ", area:" << stars[0].area << ", d:" << stars[0].diameter() << " ]" << std::endl;
+
+		if (nowTime > lastTime + std::chrono::seconds(10)) {
+			printf("Camera %d found %d stars with threshold %d\n", m_index, count, threshold);
+			printf("Brightest star [ a: %dpx, d: %0.2fpx, x: %0.2f, y: %0.2f ]\n", stars[0].area, stars[0].diameter(), stars[0].x(), stars[0].y());
+			printf("Master frame: %d, dim: %d, %d\n", m_camera->get_frame(), img.get_width(), img.get_height());
+			lastTime = nowTime;
+		}
+
+
+		/// No need to continue if in capture_mode SEARCH as we do not need to calculate seeing ///
+		if (capture_mode == C_SEARCH) {
+			m_server->applyData(m_index, img, status.str(), stars, false);
+			continue;
+		}
+
+		/// Search for a viable star
+		Image latestFrame;
+		SeeingResult result;
+		int i;
+
+		for (i = 0; i < stars.size() && m_running; ++ i) {
+
+			// Skip star if to close to edge
+			if (is_star_outside_box(img, stars[i], area)) {
+				std::cout << "Skipping star " << i << " to close on edge" << std::endl;
+				continue;
+			}
+
+			// Skip star if it is already clipped in the master frame, the burst
+			// would be overexposured too. With automatic exposure the controller
+			// brings it back below saturation before the burst.
+			int clipped = count_saturated(img, stars[i]);
+			if (clipped > 0 && !auto_exposure) {
+				std::cout << "Skipping star " << i << " overexposured, " << clipped << " clipped pixels" << std::endl;
+				continue;
+			}
+
+			// If it fails to calculate centroid of star, we will skip it too
+			double _x, _y;
+			if (m_settings->get<OptionMode>("measure_mode")->get() == M_AVERAGE && calculate_centroid(img, stars[i].x()-area, stars[i].y()-area, area, _x, _y) == 0.0) {
+				std::cout << "Skipping star " << i << " failed to calculate centroid" << std::endl;
+				continue;
+			}
+
+			// The burst is taken with the gain and exposure of the controller, it
+			// starts from the values of the previous burst and usually needs no
+			// or only a few frames to settle
+			if (auto_exposure) {
+				m_camera->set_roi(stars[i].x()-area/2.0, stars[i].y()-area/2.0, area, area);
+				m_camera->set_exposure(m_exposure_control.get_exposure());
+				m_camera->set_gain(m_exposure_control.get_gain());
+				settle_exposure(4);
+			}
+
+			// Try to calculate seeing value
+			result = measure_star(latestFrame, stars[i], area);
+
+			// if we got our value we can exit the loop
+			if (result.seeing != 0) {
+				break;
+			}
+
+			// if seeing is zero it failed to calculate seeing
+			std::cout << "Skipping star " << i << " overexposured" << std::endl;
+		}
+
+		// Serial update send seeing
+		status << "Seeing on Star" << i << ": " << result.seeing << std::endl;
+		status << "Coherence time: " << result.tau0 << "ms" << std::endl;
+		status << "Scintillation: " << result.scintillation << std::endl;
+		m_server->applyData(m_index, latestFrame, status.str(), stars, true);
+
+		double dump_seeing = m_settings->get<OptionNumber>("dump_seeing")->get();
+		if (dump_seeing > 0 && result.seeing > dump_seeing) {
+			std::ostringstream reason;
+			reason << "seeing " << result.seeing << " above " << dump_seeing;
+			dump_recent(reason.str());
+		}
+
+		if (result.seeing > 0) {
+			m_server->setSeeingData(m_index, result);
+			if (m_serial != nullptr) {
+				m_serial->send_seeing(result.seeing, result.scintillation);
+			}
+			store_seeing(result);
+
+			// The writer copies the frame, the capture does not wait for the disk
+			if (m_settings->get<OptionBool>("archive_fits")->get()) {
+				m_fits_writer.save(latestFrame, m_header, recording_filename("SE") + ".fits");
+			}
+		}
+
+		// Sleep to not constantly make measurements using the pause setting from the webinterface
+		for (int i = m_settings->get<OptionNumber>("pause")->get(); i > 0 && !m_settings->m_changed && m_running; -- i) {
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+
+			// The capture keeps running on the star, follow changes of transparency
+			// so that the next burst starts with the right exposure
+			if (auto_exposure && result.seeing > 0) {
+				settle_exposure(1);
+			}
+			if (m_server->hasClient(m_index)) {
+				m_server->applyData(m_index, latestFrame, status.str() + "Sleep Timeout: " + std::to_string(i-1) + "s", stars, true);
+			}
+		}
+
+		if (m_settings->m_changed) {
+			m_settings->m_changed = false;
+			m_exposure_control.reset(exposure, gain);
+			continue;
+		}
+	}
+}
@@ -0,0 +1,103 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "AsyncCamera.hpp"
+#include "BandwidthTuner.hpp"
+#include "Camera.hpp"
+#include "ExposureControl.hpp"
+#include "FitsWriter.hpp"
+#include "FlightRecorder.hpp"
+#include "Image.hpp"
+#include "Seeing.hpp"
+#include "SerRecorder.hpp"
+#include "Settings.hpp"
+#include "ThreadPool.hpp"
+#include "WebServer.hpp"
+#include "serial.h"
+#include "util.hpp"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+typedef enum {
+	M_AVERAGE,
+	M_CORRELATION,
+	M_FWHM,
+} MeasureMode;
+
+typedef enum {
+	C_SEARCH,
+	C_CALCULATE,
+} CaptureMode;
+
+// Star search and seeing measurement of one camera. Every camera has its own
+// pipeline with its own capture thread, settings and view in the webinterface,
+// the CPU heavy analysis of all pipelines runs on one shared thread pool.
+class Pipeline {
+public:
+	// The serial display only shows the seeing of one camera, the other
+	// pipelines get no SerialManager
+	Pipeline(int index, Camera* camera, Settings* settings, WebServer* server, SerialManager* serial, ThreadPool* pool);
+
+	~Pipeline();
+
+	bool open();
+
+	// Starts the pipeline on its own thread
+	void run();
+
+	void stop();
+
+	void close();
+
+	std::string btn_platesolving();
+
+	std::string btn_dump();
+
+	int get_index() const {
+		return m_index;
+	}
+
+private:
+	int m_index;
+	AsyncCamera* m_camera;
+	Settings* m_settings;
+	WebServer* m_server;
+	SerialManager* m_serial;
+	ThreadPool* m_pool;
+
+	BandwidthTuner* m_bandwidth_tuner; // Only set if the camera supports it
+	ExposureController m_exposure_control; // Keeps gain and exposure on the measured star between bursts
+	FlightRecorder m_flight_recorder; // Recent frames of all bursts, dumped when something goes wrong
+	FitsWriter m_fits_writer; // Plate solving and archived frames are written in the background
+	FitsHeader m_header; // Metadata of the frame that was shown last
+
+	std::thread* m_thread;
+	std::atomic<bool> m_running;
+
+	static void exec(Pipeline* pipeline);
+
+	void loop();
+
+	SeeingResult measure_star(Image& frame, const StarInfo& star, int area);
+
+	bool settle_exposure(int frames);
+
+	bool store_seeing(const SeeingResult& result);
+
+	void set_header(const FrameInfo& info);
+
+	std::string recording_filename(const std::string& prefix);
+
+	bool dump_recent(const std::string& reason);
+
+	bool astap_solve(double& ra, double& dc);
+
+	// Files of all pipelines but the first one get the index as suffix
+	std::string suffix() const {
+		return m_index == 0 ? "" : "_" + std::to_string(m_index);
+	}
+};
+
+#endif // PIPELINE_HPP
@@ -0,0 +1,586 @@
+#ifndef SEEING_HPP
+#define SEEING_HPP
+
+#include "Image.hpp"
+#include "Profil.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <vector>
+
+// Result of one measurement burst, everything derived from the same frames
+struct SeeingResult {
+  double seeing = 0; // seeing value according to the selected measure mode
+  double tau0 = 0;   // coherence time of the image motion in ms, 0 if unknown
+  double scintillation = 0; // normalized flux variance over the burst
+  double valid_fraction = 0; // fraction of frames that passed the quality checks
+};
+
+// Centroid of the star in one frame, t is the capture time in seconds
+// relative to the first frame of the burst and frame its index in the burst.
+// Frames where the centroid failed or that were sigma clipped are marked
+// as not valid and ignored by the estimators.
+struct CentroidSample {
+  double t;
+  double x, y;
+  double mass;
+  int frame;
+  bool valid;
+};
+
+typedef std::vector<CentroidSample> CentroidSeries;
+
+// Calculates the centroid sample of a single frame of the burst
+inline CentroidSample calculate_centroid_sample(const Image &frame, int index, double t) {
+  CentroidSample sample;
+  sample.t = t;
+  sample.frame = index;
+  sample.mass = calculate_centroid(frame, 0, 0, frame.get_width(), sample.x, sample.y);
+  sample.valid = sample.mass > 0.0;
+
+  return sample;
+}
+
+/*
+ * Calculates the centroid of every frame once, so that all seeing estimators
+ * can work on the same time series instead of recalculating it. timestamps
+ * has to contain one entry per frame.
+ */
+inline CentroidSeries calculate_centroids(const std::vector<Image> &frames,
+                                          const std::vector<double> &timestamps) {
+  CentroidSeries series;
+  series.reserve(frames.size());
+
+  for (size_t i = 0; i < frames.size(); ++i) {
+    series.push_back(calculate_centroid_sample(frames[i], i, timestamps[i] - timestamps[0]));
+  }
+
+  return series;
+}
+
+/*
+ * Running mean and variance using Welford's algorithm, so that the standard
+ * error of the mean is known after every added value without storing them.
+ */
+class StreamingStats {
+public:
+  void add(double value) {
+    m_count += 1;
+    double delta = value - m_mean;
+    m_mean += delta / m_count;
+    m_q += delta * (value - m_mean);
+  }
+
+  int count() const { return m_count; }
+
+  double mean() const { return m_mean; }
+
+  double variance() const { return m_count > 1 ? m_q / (m_count - 1) : 0; }
+
+  double standard_error() const { return m_count > 1 ? std::sqrt(variance() / m_count) : 0; }
+
+  // Standard error relative to the mean, infinite as long as it is unknown
+  double relative_error() const {
+    if (m_count < 2 || m_mean == 0) {
+      return INFINITY;
+    }
+    return standard_error() / std::abs(m_mean);
+  }
+
+private:
+  int m_count = 0;
+  double m_mean = 0;
+  double m_q = 0;
+};
+
+/*
+ * Tracks the convergence of a burst while the frames are captured. The
+ * seeing is derived from the scatter of the centroid, so the squared motion
+ * between consecutive valid frames is averaged. The burst has converged once
+ * the standard error of that average is below the target relative precision.
+ */
+class BurstConvergence {
+public:
+  BurstConvergence(double precision) : m_precision(precision) {}
+
+  void add(const CentroidSample &sample) {
+    if (!sample.valid) {
+      return;
+    }
+
+    if (m_has_prev) {
+      double dx = sample.x - m_last.x;
+      double dy = sample.y - m_last.y;
+      m_stats.add(dx * dx + dy * dy);
+    }
+
+    m_last = sample;
+    m_has_prev = true;
+  }
+
+  bool converged() const { return m_stats.relative_error() < m_precision; }
+
+  double relative_error() const { return m_stats.relative_error(); }
+
+private:
+  double m_precision;
+  CentroidSample m_last;
+  bool m_has_prev = false;
+  StreamingStats m_stats;
+};
+
+// Median of the values, the vector is reordered in the process
+inline double median(std::vector<double> &values) {
+  if (values.empty()) {
+    return 0;
+  }
+
+  size_t mid = values.size() / 2;
+  std::nth_element(values.begin(), values.begin() + mid, values.end());
+  double result = values[mid];
+
+  if (values.size() % 2 == 0) {
+    result = (result + *std::max_element(values.begin(), values.begin() + mid)) / 2.0;
+  }
+
+  return result;
+}
+
+// Standard deviation estimated from the median absolute deviation, which
+// unlike the normal standard deviation is not affected by a few outliers
+inline double mad_sigma(const std::vector<double> &values, double center) {
+  std::vector<double> deviations(values.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    deviations[i] = std::abs(values[i] - center);
+  }
+
+  return 1.4826 * median(deviations);
+}
+
+inline double valid_fraction(const CentroidSeries &series) {
+  if (series.empty()) {
+    return 0;
+  }
+
+  int count = 0;
+  for (const CentroidSample &sample : series) {
+    count += sample.valid;
+  }
+
+  return count / (double)series.size();
+}
+
+/*
+ * Marks frames as not valid whose flux or position is an outlier, for example
+ * because of a satellite, a cosmic ray or a single bad frame. Outliers are
+ * more than kappa robust standard deviations away from the median flux or
+ * from the linear drift of the star. Repeats until no more frames are
+ * rejected, returns the amount of rejected frames.
+ */
+inline int sigma_clip_series(CentroidSeries &series, double kappa, int iterations = 5) {
+  int rejected = 0;
+
+  for (int iteration = 0; iteration < iterations; ++iteration) {
+    std::vector<double> masses;
+    double mean_f = 0, mean_x = 0, mean_y = 0;
+
+    for (const CentroidSample &sample : series) {
+      if (sample.valid) {
+        masses.push_back(sample.mass);
+        mean_f += sample.frame;
+        mean_x += sample.x;
+        mean_y += sample.y;
+      }
+    }
+
+    const size_t n = masses.size();
+    if (n < 3) {
+      break;
+    }
+
+    mean_f /= n;
+    mean_x /= n;
+    mean_y /= n;
+
+    // Linear drift of the star over the burst
+    double s_ff = 0, s_fx = 0, s_fy = 0;
+    for (const CentroidSample &sample : series) {
+      if (sample.valid) {
+        s_ff += (sample.frame - mean_f) * (sample.frame - mean_f);
+        s_fx += (sample.frame - mean_f) * (sample.x - mean_x);
+        s_fy += (sample.frame - mean_f) * (sample.y - mean_y);
+      }
+    }
+    double drift_x = s_ff > 0 ? s_fx / s_ff : 0;
+    double drift_y = s_ff > 0 ? s_fy / s_ff : 0;
+
+    std::vector<double> residuals;
+    for (const CentroidSample &sample : series) {
+      if (sample.valid) {
+        double dx = sample.x - (mean_x + drift_x * (sample.frame - mean_f));
+        double dy = sample.y - (mean_y + drift_y * (sample.frame - mean_f));
+        residuals.push_back(std::sqrt(dx * dx + dy * dy));
+      }
+    }
+
+    double median_mass = median(masses);
+    double sigma_mass = mad_sigma(masses, median_mass);
+    double median_residual = median(residuals);
+    double sigma_residual = mad_sigma(residuals, median_residual);
+
+    int clipped = 0;
+    for (CentroidSample &sample : series) {
+      if (!sample.valid) {
+        continue;
+      }
+
+      double dx = sample.x - (mean_x + drift_x * (sample.frame - mean_f));
+      double dy = sample.y - (mean_y + drift_y * (sample.frame - mean_f));
+      double residual = std::sqrt(dx * dx + dy * dy);
+
+      bool bad_mass = sigma_mass > 0 && std::abs(sample.mass - median_mass) > kappa * sigma_mass;
+      bool bad_position = sigma_residual > 0 && residual - median_residual > kappa * sigma_residual;
+
+      if (bad_mass || bad_position) {
+        sample.valid = false;
+        clipped += 1;
+      }
+    }
+
+    rejected += clipped;
+    if (clipped == 0) {
+      break;
+    }
+  }
+
+  return rejected;
+}
+
+/*
+ * In-place iterative radix-2 FFT, data.size() has to be a power of two.
+ * If inverse is true the inverse transform is calculated (without the 1/n
+ * normalization).
+ */
+inline void fft(std::vector<std::complex<double>> &data, bool inverse) {
+  const size_t n = data.size();
+
+  // Bit reversal permutation
+  for (size_t i = 1, j = 0; i < n; ++i) {
+    size_t bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+
+    if (i < j) {
+      std::swap(data[i], data[j]);
+    }
+  }
+
+  // Butterflies
+  for (size_t len = 2; len <= n; len <<= 1) {
+    double angle = 2 * M_PI / len * (inverse ? 1 : -1);
+    std::complex<double> wlen(std::cos(angle), std::sin(angle));
+
+    for (size_t i = 0; i < n; i += len) {
+      std::complex<double> w(1);
+      for (size_t k = 0; k < len / 2; ++k) {
+        std::complex<double> u = data[i + k];
+        std::complex<double> v = data[i + k + len / 2] * w;
+        data[i + k] = u + v;
+        data[i + k + len / 2] = u - v;
+        w *= wlen;
+      }
+    }
+  }
+}
+
+/*
+ * Returns the power spectrum of the signal, zero padded to twice the next
+ * power of two so that the autocorrelation calculated from it is not circular.
+ */
+inline std::vector<double> padded_power_spectrum(const std::vector<double> &signal) {
+  size_t size = 1;
+  while (size < 2 * signal.size()) {
+    size <<= 1;
+  }
+
+  std::vector<std::complex<double>> data(size, 0.0);
+  for (size_t i = 0; i < signal.size(); ++i) {
+    data[i] = signal[i];
+  }
+
+  fft(data, false);
+
+  std::vector<double> power(size);
+  for (size_t i = 0; i < size; ++i) {
+    power[i] = std::norm(data[i]);
+  }
+
+  return power;
+}
+
+/*
+ * Returns the power spectrum of the signal after removing its linear trend
+ * (the drift of the star). Samples that are not valid are left out of the fit
+ * and set to 0, so that they do not contribute to the autocorrelation.
+ */
+inline std::vector<double> power_spectrum(const std::vector<double> &signal, const std::vector<double> &valid) {
+  const size_t n = signal.size();
+
+  // Least squares fit of a line through the valid samples to remove the drift
+  double count = 0, mean_i = 0, mean_v = 0;
+  for (size_t i = 0; i < n; ++i) {
+    count += valid[i];
+    mean_i += valid[i] * i;
+    mean_v += valid[i] * signal[i];
+  }
+  mean_i /= count;
+  mean_v /= count;
+
+  double s_iv = 0, s_ii = 0;
+  for (size_t i = 0; i < n; ++i) {
+    s_iv += valid[i] * (i - mean_i) * (signal[i] - mean_v);
+    s_ii += valid[i] * (i - mean_i) * (i - mean_i);
+  }
+  double slope = s_ii > 0 ? s_iv / s_ii : 0;
+
+  std::vector<double> residual(n);
+  for (size_t i = 0; i < n; ++i) {
+    residual[i] = valid[i] * (signal[i] - mean_v - slope * (i - mean_i));
+  }
+
+  return padded_power_spectrum(residual);
+}
+
+/*
+ * Autocovariance of the centroid motion (x and y combined) for all lags in
+ * frames up to the length of the burst, calculated from the power spectrum using the
+ * Wiener-Khinchin theorem in O(n log n).
+ */
+inline std::vector<double> motion_autocovariance(const CentroidSeries &series) {
+  if (series.empty() || valid_fraction(series) == 0) {
+    return {};
+  }
+
+  // The samples are placed on a grid by their frame index, the FFT needs
+  // evenly spaced samples. Skipped frames and frames that are not valid are
+  // masked out, every lag only averages over pairs of valid samples.
+  const int first = series.front().frame;
+  const size_t n = series.back().frame - first + 1;
+
+  std::vector<double> xs(n, 0.0), ys(n, 0.0), valid(n, 0.0);
+  for (const CentroidSample &sample : series) {
+    if (sample.valid) {
+      xs[sample.frame - first] = sample.x;
+      ys[sample.frame - first] = sample.y;
+      valid[sample.frame - first] = 1;
+    }
+  }
+
+  std::vector<double> px = power_spectrum(xs, valid);
+  std::vector<double> py = power_spectrum(ys, valid);
+  std::vector<double> pv = padded_power_spectrum(valid);
+
+  std::vector<std::complex<double>> data(px.size()), pairs(pv.size());
+  for (size_t i = 0; i < px.size(); ++i) {
+    data[i] = px[i] + py[i];
+    pairs[i] = pv[i];
+  }
+
+  fft(data, true);
+  fft(pairs, true);
+
+  // Unbiased estimate, divide by the amount of valid pairs per lag. A lag
+  // without any pair keeps the value of the previous one.
+  std::vector<double> cov(n);
+  for (size_t lag = 0; lag < n; ++lag) {
+    double count = std::round(pairs[lag].real() / pairs.size());
+    cov[lag] = count > 0 ? data[lag].real() / data.size() / count : cov[lag - 1];
+  }
+
+  return cov;
+}
+
+/*
+ * Estimates the coherence time in ms as the lag at which the normalized
+ * autocorrelation of the centroid motion drops below 1/e, which is where the
+ * structure function reaches 1 - 1/e of its saturation value. The lags are
+ * frame indices, the frame interval is taken from the timestamps.
+ * Returns 0 if the series is too short or does not decorrelate within half
+ * of the burst.
+ */
+inline double calculate_coherence_time(const CentroidSeries &series) {
+  const size_t n = series.size();
+
+  if (n < 8 || series[n - 1].t <= series[0].t || valid_fraction(series) == 0) {
+    return 0;
+  }
+
+  // Interval between two frames, the lags are frame indices
+  double dt = (series[n - 1].t - series[0].t) / (series[n - 1].frame - series[0].frame);
+
+  std::vector<double> cov = motion_autocovariance(series);
+  if (cov[0] <= 0) {
+    return 0;
+  }
+
+  const double limit = std::exp(-1.0);
+  double prev = 1.0;
+
+  for (size_t lag = 1; lag < cov.size() / 2; ++lag) {
+    double corr = cov[lag] / cov[0];
+
+    if (corr <= limit) {
+      // Linear interpolation between the two neighbouring lags
+      double frac = (prev - limit) / (prev - corr);
+      return (lag - 1 + frac) * dt * 1000.0;
+    }
+
+    prev = corr;
+  }
+
+  return 0;
+}
+
+/*
+ * Scintillation index, the variance of the star flux normalized by the
+ * squared mean flux. The flux is the background subtracted mass that
+ * calculate_centroid already returns for every frame. Frames that are not
+ * valid are ignored.
+ */
+inline double calculate_scintillation(const CentroidSeries &series) {
+  double mean = 0;
+  double q = 0;
+  int count = 0;
+
+  // Welford's algorithm, numerically stable for large masses
+  for (const CentroidSample &sample : series) {
+    if (!sample.valid) {
+      continue;
+    }
+
+    count += 1;
+    double delta = sample.mass - mean;
+    mean += delta / count;
+    q += delta * (sample.mass - mean);
+  }
+
+  if (count < 2 || mean <= 0) {
+    return 0;
+  }
+
+  return (q / (count - 1)) / (mean * mean);
+}
+
+inline double calculate_seeing_correlation(const CentroidSeries &series) {
+  double avg_x = 0, avg_y = 0;
+  int count = 0;
+
+  for (const CentroidSample &sample : series) {
+    if (sample.valid) {
+      avg_x += sample.x;
+      avg_y += sample.y;
+      count++;
+    }
+  }
+
+  if (count < 2) {
+    printf("Too many frames failed to calculate centroid\n");
+    return 0;
+  }
+
+  avg_x /= count;
+  avg_y /= count;
+
+  double s_xx = 0, s_yy = 0, s_xy = 0;
+  for (const CentroidSample &sample : series) {
+    if (sample.valid) {
+      s_xy += (sample.x - avg_x) * (sample.y - avg_y);
+      s_xx += (sample.x - avg_x) * (sample.x - avg_x);
+      s_yy += (sample.y - avg_y) * (sample.y - avg_y);
+    }
+  }
+
+  // Korellationskoeffizient
+  return std::abs(s_xy / std::sqrt(s_xx * s_yy));
+}
+
+inline double calculate_seeing_fwhm(std::vector<Image> &frames) {
+  Profil profil;
+
+  float fwhm_diff_sum = 0;
+  float prev_fwhm = 0;
+  int count = 0;
+
+  // Calculate the fwhm of each frame and take the difference of each
+  for (const Image &frame : frames) {
+    profil.set_from_image(frame);
+    float fwhm = profil.get_fwhm();
+    if (fwhm > 0) {
+
+      // skip first fwhm value, as it has no prev_fwhm to calculate difference
+      if (prev_fwhm > 0)
+        fwhm_diff_sum += std::abs(prev_fwhm - fwhm);
+
+      prev_fwhm = fwhm;
+      count++;
+    }
+  }
+
+  // If it failed about half of all frames we return 0 to signalize that
+  // the calculation is invalid
+  if (count < frames.size() / 2) {
+    printf("Too many frames failed to calculate fwhm, %lu of %zu\n",
+           frames.size() - count, frames.size());
+    return 0;
+  }
+
+  // Result is the average difference of the fwhm value
+  return fwhm_diff_sum / (float)count;
+}
+
+inline double calculate_seeing_average(const CentroidSeries &series) {
+  std::vector<const CentroidSample *> valid;
+
+  for (const CentroidSample &sample : series) {
+    if (sample.valid) {
+      valid.push_back(&sample);
+    }
+  }
+
+  int count = valid.size();
+  if (count < 2) {
+    return 0;
+  }
+
+  const CentroidSample &first = *valid.front();
+  const CentroidSample &last = *valid.back();
+
+  // Calculate average movement per frame, skipped frames are accounted for
+  // by using the frame index instead of the position in the list
+  double avg_x = (last.x - first.x) / (last.frame - first.frame);
+  double avg_y = (last.y - first.y) / (last.frame - first.frame);
+
+  // Calculate scatter from Average
+  double avg_diff_x = 0.0;
+  double avg_diff_y = 0.0;
+
+  for (const CentroidSample *sample : valid) {
+    double estimated_x = first.x + avg_x * (sample->frame - first.frame);
+    double estimated_y = first.y + avg_y * (sample->frame - first.frame);
+
+    avg_diff_x += (estimated_x - sample->x) * (estimated_x - sample->x);
+    avg_diff_y += (estimated_y - sample->y) * (estimated_y - sample->y);
+  }
+
+  // Calculate seeing, the scatter is summed over the whole series. Rejected
+  // samples are replaced by the average of the valid ones, so that they do
+  // not make the seeing look better.
+  return std::sqrt((avg_diff_x + avg_diff_y) * series.size() / count);
+}
+
+#endif // SEEING_HPP
@@ -0,0 +1,327 @@
+#ifndef SER_RECORDER_HPP
+#define SER_RECORDER_HPP
+
+#include "FrameInfo.hpp"
+#include "Image.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#define RECORDER_BUFFER_SIZE (4 << 20) // Bytes written at once, a multiple of the block size
+#define RECORDER_BUFFERS 8             // Buffers in flight, frames are dropped when all are waiting for the disk
+#define RECORDER_ALIGNMENT 4096        // Alignment of buffers and offsets for O_DIRECT
+#define SER_HEADER_SIZE 178
+
+// Records 8 bit mono frames with their timestamps to a SER file. Frames are
+// copied into large aligned buffers, a writer thread writes every full
+// buffer with O_DIRECT so that the page cache is not filled with data that
+// is never read again. The capture never waits for the disk: if all buffers
+// are still waiting to be written the frame is dropped and counted instead.
+// File systems without O_DIRECT support are written through the page cache.
+//
+// The frame count in the header and the timestamps after the frames are
+// written on close.
+class SerRecorder {
+public:
+	SerRecorder() : m_fd(-1), m_direct(false), m_thread(nullptr), m_running(false), m_current(nullptr),
+		m_offset(0), m_width(0), m_height(0), m_dropped(0), m_failed(false) {}
+
+	~SerRecorder() {
+		close();
+	}
+
+	// Frames is the expected number of frames, room for their timestamps is
+	// reserved so that add does not allocate
+	bool open(const std::string& path, int width, int height, const std::string& instrument, int frames = 0) {
+		close();
+
+		m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+		m_direct = m_fd >= 0;
+		if (m_fd < 0 && errno == EINVAL) {
+			m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		}
+
+		if (m_fd < 0) {
+			printf("SerRecorder: failed to open '%s': %s\n", path.c_str(), strerror(errno));
+			return false;
+		}
+
+		for (int i = 0; i < RECORDER_BUFFERS; ++ i) {
+			void* data;
+			if (posix_memalign(&data, RECORDER_ALIGNMENT, RECORDER_BUFFER_SIZE) == 0) {
+				m_free.push_back((uint8_t*)data);
+			}
+		}
+
+		if (m_free.empty()) {
+			printf("SerRecorder: failed to allocate buffers for '%s'\n", path.c_str());
+			::close(m_fd);
+			::unlink(path.c_str());
+			m_fd = -1;
+			return false;
+		}
+
+		m_path = path;
+		m_instrument = instrument;
+		m_width = width;
+		m_height = height;
+		m_offset = 0;
+		m_dropped = 0;
+		m_failed = false;
+		m_timestamps.clear();
+		m_timestamps.reserve(frames);
+
+		// Timestamps of the frames are monotonic, SER wants them in UTC
+		m_realtime_offset = realtime_offset();
+
+		// The header is written again with the frame count on close
+		m_current = take_buffer();
+		m_used = SER_HEADER_SIZE;
+		write_header(m_current, 0);
+
+		m_running = true;
+		m_thread = new std::thread(SerRecorder::exec, this);
+
+		return true;
+	}
+
+	bool is_open() const {
+		return m_fd >= 0;
+	}
+
+	// Returns false if the frame was dropped, because the writer is behind or
+	// because its size differs from the one the file was opened with
+	bool add(const Image& img, const FrameInfo& info) {
+		size_t size = img.get_pixel_count();
+
+		if (m_fd < 0 || img.get_width() != m_width || img.get_height() != m_height) {
+			m_dropped += 1;
+			return false;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			// A frame that ends exactly at the end of a buffer needs the next one
+			if (m_used + size >= RECORDER_BUFFER_SIZE * (m_free.size() + 1)) {
+				m_dropped += 1;
+				return false;
+			}
+		}
+
+		const uint8_t* data = img.m_buffer;
+		while (size > 0) {
+			size_t count = std::min<size_t>(size, RECORDER_BUFFER_SIZE - m_used);
+			memcpy(m_current + m_used, data, count);
+			m_used += count;
+			data += count;
+			size -= count;
+
+			if (m_used == RECORDER_BUFFER_SIZE) {
+				submit();
+			}
+		}
+
+		m_timestamps.push_back(to_ticks(info.timestamp, m_realtime_offset));
+		return true;
+	}
+
+	// Writes the remaining frames, the timestamps and the final header
+	bool close() {
+		if (m_fd < 0) {
+			return true;
+		}
+
+		if (m_thread != nullptr) {
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_running = false;
+			}
+			m_cond.notify_all();
+			m_thread->join();
+			delete m_thread;
+			m_thread = nullptr;
+		}
+
+		// The tail is not a multiple of the block size
+		if (m_direct) {
+			fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+		}
+
+		bool success = !m_failed && write_all(m_current, m_used, m_offset);
+		off_t end = m_offset + m_used;
+		success = success && write_all((const uint8_t*)m_timestamps.data(), m_timestamps.size() * sizeof(int64_t), end);
+
+		uint8_t header[SER_HEADER_SIZE];
+		write_header(header, m_timestamps.size());
+		success = success && write_all(header, SER_HEADER_SIZE, 0);
+
+		::close(m_fd);
+		m_fd = -1;
+
+		m_free.push_back(m_current);
+		m_current = nullptr;
+		for (uint8_t* buffer : m_free) {
+			free(buffer);
+		}
+		m_free.clear();
+
+		printf("SerRecorder: %zu frames written to '%s'%s, %d dropped\n", m_timestamps.size(), m_path.c_str(),
+			success ? "" : " with errors", m_dropped);
+		return success;
+	}
+
+	int get_frames() const {
+		return m_timestamps.size();
+	}
+
+	int get_dropped() const {
+		return m_dropped;
+	}
+
+	// Builds the header of an 8 bit mono SER file, utc is the time of the
+	// first frame in SER ticks or 0 if unknown
+	static void make_header(uint8_t* header, int width, int height, int frames, const std::string& instrument, int64_t utc) {
+		int64_t local = 0;
+		if (utc != 0) {
+			time_t now = time(nullptr);
+			struct tm tm;
+			localtime_r(&now, &tm);
+			local = utc + tm.tm_gmtoff * 10000000LL;
+		}
+
+		int32_t values[7] = {0, 0, 0, width, height, 8, frames}; // LuID, ColorID (mono), LittleEndian, ...
+
+		memset(header, 0, SER_HEADER_SIZE);
+		memcpy(header, "LUCAM-RECORDER", 14);
+		memcpy(header + 14, values, sizeof(values));
+		strncpy((char*)header + 82, instrument.c_str(), 40);
+		memcpy(header + 162, &local, sizeof(local));
+		memcpy(header + 170, &utc, sizeof(utc));
+	}
+
+	// SER timestamps are ticks of 100 ns since 0001-01-01 UTC
+	static int64_t to_ticks(int64_t timestamp, int64_t offset) {
+		return (timestamp + offset) / 100 + 621355968000000000LL;
+	}
+
+private:
+	int m_fd;
+	bool m_direct;
+	std::string m_path, m_instrument;
+
+	std::thread* m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	bool m_running;
+
+	std::vector<uint8_t*> m_free; // Buffers that can be filled
+	std::deque<std::pair<uint8_t*, off_t>> m_queue; // Full buffers and their offset in the file
+	uint8_t* m_current; // Buffer that is filled right now, owned by the capture side
+	size_t m_used;
+	off_t m_offset; // Offset of the current buffer in the file
+
+	int m_width, m_height;
+	int m_dropped;
+	std::atomic<bool> m_failed;
+	int64_t m_realtime_offset;
+	std::vector<int64_t> m_timestamps;
+
+	// Waits for a free buffer, add makes sure that there is one
+	uint8_t* take_buffer() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cond.wait(lock, [this] {
+			return !m_free.empty();
+		});
+
+		uint8_t* buffer = m_free.back();
+		m_free.pop_back();
+		return buffer;
+	}
+
+	// Hands the full current buffer to the writer thread
+	void submit() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_queue.push_back(std::make_pair(m_current, m_offset));
+		}
+		m_cond.notify_all();
+
+		m_offset += RECORDER_BUFFER_SIZE;
+		m_current = take_buffer();
+		m_used = 0;
+	}
+
+	bool write_all(const uint8_t* data, size_t size, off_t offset) {
+		while (size > 0) {
+			ssize_t written = pwrite(m_fd, data, size, offset);
+
+			// Some file systems accept O_DIRECT on open but not on write
+			if (written < 0 && errno == EINVAL && m_direct) {
+				fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+				m_direct = false;
+				continue;
+			}
+
+			if (written <= 0) {
+				printf("SerRecorder: failed to write '%s': %s\n", m_path.c_str(), strerror(errno));
+				return false;
+			}
+
+			data += written;
+			size -= written;
+			offset += written;
+		}
+
+		return true;
+	}
+
+	void write_header(uint8_t* header, int frames) {
+		make_header(header, m_width, m_height, frames, m_instrument, m_timestamps.empty() ? 0 : m_timestamps.front());
+	}
+
+	static void exec(SerRecorder* recorder) {
+		for (;;) {
+			std::pair<uint8_t*, off_t> buffer;
+			{
+				std::unique_lock<std::mutex> lock(recorder->m_mutex);
+				recorder->m_cond.wait(lock, [recorder] {
+					return !recorder->m_queue.empty() || !recorder->m_running;
+				});
+
+				if (recorder->m_queue.empty()) {
+					return;
+				}
+
+				buffer = recorder->m_queue.front();
+				recorder->m_queue.pop_front();
+			}
+
+			if (!recorder->write_all(buffer.first, RECORDER_BUFFER_SIZE, buffer.second)) {
+				recorder->m_failed = true;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(recorder->m_mutex);
+				recorder->m_free.push_back(buffer.first);
+			}
+			recorder->m_cond.notify_all();
+		}
+	}
+};
+
+#endif // SER_RECORDER_HPP
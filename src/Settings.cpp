@@ -1,16 +1,16 @@
 #include "Settings.hpp"
 #include <crow/returnable.h>
 
-Settings::Settings(const Config& values) : m_values(values), m_changed(false) {
+Settings::Settings(const Config& values, const std::string& filename) : m_values(values), m_changed(false), m_filename(filename) {
 	char line[200];
 
-	std::ifstream file(cfg_filename);
+	std::ifstream file(m_filename);
 
 	if (!file.is_open()) {
-		std::cout << "Failed to open '" << cfg_filename << "' in Settings::Settings with the reason: " << strerror(errno) << std::endl;
+		std::cout << "Failed to open '" << m_filename << "' in Settings::Settings with the reason: " << strerror(errno) << std::endl;
 		return;
 	} else {
-		std::cout << "Opened settings file " << cfg_filename << std::endl;
+		std::cout << "Opened settings file " << m_filename << std::endl;
 	}
 
 	for (;;) {
@@ -41,10 +41,10 @@ Settings::~Settings() {
 }
 
 bool Settings::store() {
-	std::ofstream file(cfg_filename);
+	std::ofstream file(m_filename);
 
 	if (!file.is_open()) {
-		std::cout << "Failed to open '" << cfg_filename << "' in Settings::store with the reason: " << strerror(errno) << std::endl;
+		std::cout << "Failed to open '" << m_filename << "' in Settings::store with the reason: " << strerror(errno) << std::endl;
 		return false;
 	}
 
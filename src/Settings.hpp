@@ -42,7 +42,8 @@ class Settings {
 public:
 	typedef std::map<std::string, Option*> Config;
 
-	Settings(const Config& values);
+	// Every camera has its own settings file, the first one uses cfg_filename
+	Settings(const Config& values, const std::string& filename = cfg_filename);
 
 	~Settings();
 
@@ -60,6 +61,7 @@ public:
 
 private:
 	Config m_values;
+	std::string m_filename;
 };
 
 
@@ -0,0 +1,420 @@
+#ifndef SYNTHETIC_CAMERA_HPP
+#define SYNTHETIC_CAMERA_HPP
+
+#include "Camera.hpp"
+#include "Image.hpp"
+#include "Seeing.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define TURBULENCE_SAMPLES 65536 // Length of the precomputed turbulence series, it repeats afterwards
+#define TURBULENCE_STEP 0.0005   // Time between two samples of the turbulence series in s
+
+// Parameters of the SyntheticCamera, given as "key=value" pairs separated by
+// commas, e.g. "fwhm=3,jitter=0.8,stars=20". Lengths are in unbinned pixels.
+struct SyntheticConfig {
+	int width = 1936, height = 1096; // Sensor size
+	int stars = 10;         // Number of stars, the first one is the brightest
+	double peak = 150;      // Peak of the brightest star in ADU at 10 ms exposure and gain 0
+	bool moffat = false;    // Moffat instead of Gaussian PSF
+	double beta = 2.5;      // Exponent of the Moffat PSF
+	double fwhm = 4;        // FWHM of the PSF
+	double jitter = 1;      // RMS of the tip-tilt per axis
+	double tau = 5;         // Coherence time of the tip-tilt in ms
+	double scint = 0.05;    // Scintillation index, variance of the flux over its squared mean
+	double background = 10; // Sky background in ADU
+	double noise = 2;       // Read noise RMS in ADU at gain 0
+	double shot = 0.3;      // Shot noise RMS per square root of the signal in ADU
+	double hot = 1e-5;      // Fraction of hot pixels
+	double drift_x = 0, drift_y = 0; // Drift of the field in pixels per second
+	double fps = 0;         // Frame rate limit, 0 if the exposure is the only limit
+	int seed = 1;
+
+	// Unknown keys are reported, returns false if there were any
+	bool parse(const std::string& options) {
+		std::stringstream stream(options);
+		std::string item;
+		bool success = true;
+
+		while (std::getline(stream, item, ',')) {
+			int deli = item.find('=');
+			if (deli <= 0) {
+				continue;
+			}
+
+			std::string key = item.substr(0, deli);
+			double value = std::atof(item.substr(deli+1).c_str());
+
+			if (key == "width") width = value;
+			else if (key == "height") height = value;
+			else if (key == "stars") stars = value;
+			else if (key == "peak") peak = value;
+			else if (key == "psf") moffat = item.substr(deli+1) == "moffat";
+			else if (key == "beta") beta = value;
+			else if (key == "fwhm") fwhm = value;
+			else if (key == "jitter") jitter = value;
+			else if (key == "tau") tau = value;
+			else if (key == "scint") scint = value;
+			else if (key == "background") background = value;
+			else if (key == "noise") noise = value;
+			else if (key == "shot") shot = value;
+			else if (key == "hot") hot = value;
+			else if (key == "drift_x") drift_x = value;
+			else if (key == "drift_y") drift_y = value;
+			else if (key == "fps") fps = value;
+			else if (key == "seed") seed = value;
+			else {
+				printf("SyntheticCamera: unknown option '%s'\n", key.c_str());
+				success = false;
+			}
+		}
+
+		return success;
+	}
+};
+
+// Renders star fields with known seeing on the fly, to test the measurement
+// and to benchmark the pipeline at any ROI and frame rate without a camera.
+//
+// The tip-tilt follows a Kolmogorov temporal spectrum, f^(-2/3) below the
+// knee at 1/(2 pi tau) and f^(-11/3) above it, and is shared by all stars.
+// The scintillation multiplies the flux with a log-normal factor. Only the
+// ROI is rendered: every star is drawn into a box around it from separable
+// profiles for the Gaussian PSF, then noise is added and the frame is
+// converted to 8 bit. The inner loops are plain arrays of floats without
+// branches so that the compiler vectorizes them.
+class SyntheticCamera : public Camera {
+public:
+	SyntheticCamera(const std::string& options) : m_options(options), m_opened(false),
+		m_exposure_time(10000), m_gain(0), m_bin(1), m_frame(0) {}
+
+	bool open() {
+		if (!m_config.parse(m_options)) {
+			return false;
+		}
+
+		std::mt19937 random(m_config.seed);
+		std::uniform_real_distribution<double> uniform(0, 1);
+
+		// The brightest star is near the centre, the other ones up to 4 magnitudes fainter
+		m_stars.clear();
+		for (int i = 0; i < m_config.stars; ++ i) {
+			Star star;
+			star.x = i == 0 ? m_config.width * (0.4 + 0.2 * uniform(random)) : m_config.width * uniform(random);
+			star.y = i == 0 ? m_config.height * (0.4 + 0.2 * uniform(random)) : m_config.height * uniform(random);
+			star.peak = m_config.peak * (i == 0 ? 1 : std::pow(10, -0.4 * 4 * uniform(random)));
+			m_stars.push_back(star);
+		}
+
+		m_hot_pixels.clear();
+		int hot = m_config.width * m_config.height * m_config.hot;
+		for (int i = 0; i < hot; ++ i) {
+			m_hot_pixels.push_back(std::make_pair((int)(random() % m_config.width), (int)(random() % m_config.height)));
+		}
+
+		// Noise is taken from a table at a random offset per row, drawing a
+		// normal sample per pixel would limit the frame rate
+		std::normal_distribution<float> normal(0, 1);
+		m_noise.resize(65536 + m_config.width);
+		for (float& value : m_noise) {
+			value = normal(random);
+		}
+
+		double knee = 1000 / (2 * M_PI * m_config.tau);
+		m_tip = turbulence(random, knee);
+		m_tilt = turbulence(random, knee);
+		m_flux = turbulence(random, knee * 4);
+
+		printf("Synthetic camera %dx%d with %d stars, FWHM %0.2f px, tip-tilt %0.2f px RMS, tau %0.1f ms, scintillation %0.3f\n",
+			m_config.width, m_config.height, m_config.stars, m_config.fwhm, m_config.jitter, m_config.tau, m_config.scint);
+
+		m_start = monotonic_ns();
+		m_opened = true;
+		m_bin = 1;
+
+		return set_roi(0, 0, m_config.width, m_config.height);
+	}
+
+	bool get_fullsize(int &width, int &height) {
+		width = m_config.width;
+		height = m_config.height;
+
+		return true;
+	}
+
+	bool set_roi(int cx, int cy, int width, int height) {
+		m_width = std::min(std::max(width, m_bin), m_config.width) / m_bin * m_bin;
+		m_height = std::min(std::max(height, m_bin), m_config.height) / m_bin * m_bin;
+		m_cx = std::min(std::max(cx, 0), m_config.width - m_width);
+		m_cy = std::min(std::max(cy, 0), m_config.height - m_height);
+
+		return true;
+	}
+
+	bool set_bin(int bin) {
+		if (bin < 1 || bin > 4) {
+			return false;
+		}
+		m_bin = bin;
+		return set_roi(m_cx, m_cy, m_width, m_height);
+	}
+
+	int get_bin() {
+		return m_bin;
+	}
+
+	bool get_data(Image& img, FrameInfo* info = nullptr) {
+		if (!m_opened) {
+			return false;
+		}
+
+		int64_t begin = monotonic_ns();
+		int64_t interval = m_config.fps > 0 ? std::max<int64_t>(m_exposure_time * 1000LL, 1e9 / m_config.fps) : m_exposure_time * 1000LL;
+		int64_t exposure_end = begin + interval;
+
+		render(img, (exposure_end - m_start) * 1e-9);
+		m_frame ++;
+
+		int64_t delay = exposure_end - monotonic_ns();
+		if (delay > 0) {
+			std::this_thread::sleep_for(std::chrono::nanoseconds(delay));
+		}
+
+		if (info != nullptr) {
+			info->timestamp = exposure_end;
+			info->exposure = m_exposure_time;
+			info->gain = m_gain;
+			info->roi_x = m_cx;
+			info->roi_y = m_cy;
+			info->roi_width = m_width;
+			info->roi_height = m_height;
+			info->bin = m_bin;
+			info->sequence = m_frame;
+			info->dropped = 0;
+		}
+
+		m_latency.add(monotonic_ns() - exposure_end);
+
+		return true;
+	}
+
+	bool start_capture() {
+		return m_opened;
+	}
+
+	bool stop_capture() {
+		return true;
+	}
+
+	void set_exposure(int value) {
+		m_exposure_time = value;
+	}
+
+	void set_gain(int value) {
+		m_gain = value;
+	}
+
+	bool set_bandwidth(int bandwidth, bool high_speed) {
+		return false;
+	}
+
+	std::string get_name() {
+		return "Synthetic Camera";
+	}
+
+	void close() {
+		m_opened = false;
+	}
+
+	int get_dropped_frames() {
+		return 0;
+	}
+
+	int get_frame() {
+		return m_frame;
+	}
+
+private:
+	struct Star {
+		double x, y;
+		double peak;
+	};
+
+	std::string m_options;
+	SyntheticConfig m_config;
+	bool m_opened;
+
+	std::vector<Star> m_stars;
+	std::vector<std::pair<int, int>> m_hot_pixels;
+	std::vector<float> m_noise;
+	std::vector<float> m_tip, m_tilt, m_flux; // Turbulence series with unit RMS
+
+	std::vector<float> m_pixels; // Frame before the conversion to 8 bit
+	std::vector<float> m_profile_x, m_profile_y;
+
+	int m_cx, m_cy, m_width, m_height;
+	int m_exposure_time;
+	int m_gain;
+	int m_bin;
+	int m_frame;
+	int64_t m_start;
+	std::mt19937 m_random;
+
+	// Random series with unit RMS and a Kolmogorov like spectrum with the
+	// knee at the given frequency in Hz, made by shaping white noise in the
+	// frequency domain
+	static std::vector<float> turbulence(std::mt19937& random, double knee) {
+		const int n = TURBULENCE_SAMPLES;
+		std::vector<std::complex<double>> data(n, 0.0);
+		std::uniform_real_distribution<double> phase(0, 2 * M_PI);
+
+		for (int k = 1; k < n / 2; ++ k) {
+			double f = k / (n * TURBULENCE_STEP);
+			double amplitude = f < knee ? std::pow(f, -1.0/3) : std::pow(knee, -1.0/3) * std::pow(f / knee, -11.0/6);
+
+			data[k] = std::polar(amplitude, phase(random));
+			data[n - k] = std::conj(data[k]);
+		}
+
+		fft(data, true);
+
+		double sum = 0;
+		for (int i = 0; i < n; ++ i) {
+			sum += data[i].real() * data[i].real();
+		}
+		double rms = std::sqrt(sum / n);
+
+		std::vector<float> series(n);
+		for (int i = 0; i < n; ++ i) {
+			series[i] = data[i].real() / rms;
+		}
+
+		return series;
+	}
+
+	// Adds a star with the given peak at the position in binned ROI pixels
+	void draw_star(int width, int height, double x, double y, double peak, double fwhm) {
+		const double sigma = fwhm / 2.3548;
+		const int radius = std::ceil(m_config.moffat ? 3 * fwhm : 4 * sigma);
+
+		int x0 = std::max<int>(std::floor(x) - radius, 0), x1 = std::min<int>(std::floor(x) + radius + 1, width);
+		int y0 = std::max<int>(std::floor(y) - radius, 0), y1 = std::min<int>(std::floor(y) + radius + 1, height);
+		if (x0 >= x1 || y0 >= y1) {
+			return;
+		}
+
+		draw_psf(width, x0, x1, y0, y1, x, y, peak, fwhm);
+
+		// Shot noise of the star, the background gets its noise in render. The
+		// average of bin^2 pixels has 1/bin of their noise.
+		const float shot = m_config.shot / m_bin;
+		const float background = m_config.background;
+		for (int py = y0; py < y1; ++ py) {
+			float* row = &m_pixels[py * width];
+			const float* noise = &m_noise[m_random() & 0xFFFF];
+			for (int px = x0; px < x1; ++ px) {
+				row[px] += noise[px] * shot * std::sqrt(std::max(row[px] - background, 0.0f));
+			}
+		}
+	}
+
+	// Adds the PSF within the box [x0, x1) x [y0, y1)
+	void draw_psf(int width, int x0, int x1, int y0, int y1, double x, double y, double peak, double fwhm) {
+		const double sigma = fwhm / 2.3548;
+
+		if (m_config.moffat) {
+			// Not separable, evaluated per pixel
+			const float alpha2 = fwhm * fwhm / (4 * (std::pow(2, 1 / m_config.beta) - 1));
+			const float beta = -m_config.beta;
+
+			for (int py = y0; py < y1; ++ py) {
+				float* row = &m_pixels[py * width];
+				float dy2 = (py - y) * (py - y);
+				for (int px = x0; px < x1; ++ px) {
+					row[px] += peak * std::pow(1 + ((px - x) * (px - x) + dy2) / alpha2, beta);
+				}
+			}
+			return;
+		}
+
+		m_profile_x.resize(x1 - x0);
+		m_profile_y.resize(y1 - y0);
+		for (int px = x0; px < x1; ++ px) {
+			m_profile_x[px - x0] = std::exp(-(px - x) * (px - x) / (2 * sigma * sigma));
+		}
+		for (int py = y0; py < y1; ++ py) {
+			m_profile_y[py - y0] = peak * std::exp(-(py - y) * (py - y) / (2 * sigma * sigma));
+		}
+
+		const float* profile = m_profile_x.data();
+		for (int py = y0; py < y1; ++ py) {
+			float* row = &m_pixels[py * width + x0];
+			const float scale = m_profile_y[py - y0];
+			for (int i = 0; i < x1 - x0; ++ i) {
+				row[i] += scale * profile[i];
+			}
+		}
+	}
+
+	void render(Image& img, double t) {
+		const int width = m_width / m_bin, height = m_height / m_bin;
+		const int sample = (int64_t)(t / TURBULENCE_STEP) % TURBULENCE_SAMPLES;
+		const double signal = m_exposure_time / 10000.0 * std::pow(10, m_gain / 200.0);
+		const double sigma_ln = std::sqrt(std::log(1 + m_config.scint));
+		const double flux = std::exp(sigma_ln * m_flux[sample] - sigma_ln * sigma_ln / 2);
+
+		const double dx = m_config.jitter * m_tip[sample] + m_config.drift_x * t;
+		const double dy = m_config.jitter * m_tilt[sample] + m_config.drift_y * t;
+
+		if (img.get_width() != width || img.get_height() != height) {
+			img.set(width, height);
+		}
+
+		m_pixels.assign(width * height, m_config.background);
+
+		// Binning averages bin x bin pixels like Image::get_binned, the star
+		// shrinks but its peak and the background stay the same
+		for (const Star& star : m_stars) {
+			double x = (star.x + dx - m_cx) / m_bin - 0.5 + 0.5 / m_bin;
+			double y = (star.y + dy - m_cy) / m_bin - 0.5 + 0.5 / m_bin;
+			draw_star(width, height, x, y, star.peak * signal * flux, m_config.fwhm / m_bin);
+		}
+
+		// Read noise is amplified by the gain, the shot noise of the stars was
+		// added with them, the one of the flat background is added here. Both
+		// are reduced to 1/bin by averaging the binned pixels.
+		const float read = m_config.noise * std::pow(10, m_gain / 200.0);
+		const float sigma = std::sqrt(read * read + m_config.shot * m_config.shot * m_config.background) / m_bin;
+
+		for (int py = 0; py < height; ++ py) {
+			const float* noise = &m_noise[m_random() & 0xFFFF];
+			const float* row = &m_pixels[py * width];
+			uint8_t* out = &img.m_buffer[py * width];
+
+			for (int px = 0; px < width; ++ px) {
+				float value = row[px] + noise[px] * sigma;
+				out[px] = std::min(std::max(value, 0.0f), 255.0f);
+			}
+		}
+
+		for (const std::pair<int, int>& pixel : m_hot_pixels) {
+			int px = (pixel.first - m_cx) / m_bin, py = (pixel.second - m_cy) / m_bin;
+			if (pixel.first >= m_cx && pixel.second >= m_cy && px < width && py < height) {
+				img.m_buffer[py * width + px] = 255;
+			}
+		}
+	}
+};
+
+#endif // SYNTHETIC_CAMERA_HPP
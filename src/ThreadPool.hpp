@@ -0,0 +1,88 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed number of worker threads that execute submitted tasks in order of
+// submission. It is shared by all pipelines, so that the CPU heavy work of
+// several cameras is spread over the cores without starting more threads
+// than there are cores.
+class ThreadPool {
+public:
+	ThreadPool(int threads = std::thread::hardware_concurrency()) : m_running(true) {
+		for (int i = 0; i < std::max(threads, 1); ++ i) {
+			m_workers.push_back(new std::thread(ThreadPool::exec, this));
+		}
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_running = false;
+		}
+		m_cond.notify_all();
+
+		for (std::thread* worker : m_workers) {
+			worker->join();
+			delete worker;
+		}
+	}
+
+	// Queues the task and returns a future for its result
+	template<typename F>
+	auto submit(F task) -> std::future<decltype(task())> {
+		auto job = std::make_shared<std::packaged_task<decltype(task())()>>(task);
+		std::future<decltype(task())> result = job->get_future();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_tasks.push([job] { (*job)(); });
+		}
+		m_cond.notify_one();
+
+		return result;
+	}
+
+	int size() const {
+		return m_workers.size();
+	}
+
+private:
+	std::vector<std::thread*> m_workers;
+	std::queue<std::function<void()>> m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	bool m_running;
+
+	static void exec(ThreadPool* pool) {
+		for (;;) {
+			std::function<void()> task;
+
+			{
+				std::unique_lock<std::mutex> lock(pool->m_mutex);
+				pool->m_cond.wait(lock, [pool] {
+					return !pool->m_running || !pool->m_tasks.empty();
+				});
+
+				if (!pool->m_running && pool->m_tasks.empty()) {
+					return;
+				}
+
+				task = std::move(pool->m_tasks.front());
+				pool->m_tasks.pop();
+			}
+
+			task();
+		}
+	}
+};
+
+#endif // THREAD_POOL_HPP
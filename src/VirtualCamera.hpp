@@ -2,6 +2,7 @@
 #define VIRTUAL_CAMERA_HPP
 
 #include "Camera.hpp"
+#include "FrameSource.hpp"
 #include "Image.hpp"
 
 #include <algorithm>
@@ -16,46 +17,45 @@
 #include <tiffio.h>
 #include <vector>
 #include <string>
-#include <dirent.h>
 #include <thread>
 
 
 #include <fitsio2.h>
 
+// Replays recorded frames from a FrameSource as if they came from a camera,
+// the source is deleted with the camera.
+//
+// The replay runs on a virtual clock that advances by the recorded interval
+// between the frames, or by the exposure time if the source has no
+// timestamps, so the timestamps keep the recorded cadence at any speed. At speed 1
+// it follows the real clock like a camera, at speed N it runs N times faster.
+// At speed 0 it runs free without any sleeps, as fast as the frames are
+// consumed, and no frame is skipped (see is_realtime).
+#define REPLAY_REPORT_INTERVAL 10 // Seconds between two reports of the achieved frame rate
+
 class VirtualCamera : public Camera {
 public:
-	VirtualCamera(std::string path) : m_path(path), m_exposure_time(10000), m_frame(0) {
-		if (m_path[m_path.size()-1] != '\\' && m_path[m_path.size()-1] != '/') {
-			m_path += '/';
-		}
+	VirtualCamera(FrameSource* source, double speed = 1) : m_source(source), m_speed(speed), m_exposure_time(10000), m_frame(0), m_captured(0), m_dropped(0), m_bin(1), m_gain(0), m_views(false) {
+		// The virtual clock keeps running across a reopen of the camera
+		m_real_start = monotonic_ns();
+		m_clock_start = m_real_start;
+		m_clock = m_real_start;
+		m_report_time = m_real_start;
+		m_report_clock = m_clock;
+		m_report_frame = 0;
 	}
 
-	bool open() { 
-		std::cout << "Loading images for virtual camera from folder: " << m_path << std::endl;
-
-		struct dirent **namelist;
-		int n;
+	~VirtualCamera() {
+		delete m_source;
+	}
 
-		if ((n = scandir(m_path.c_str(), &namelist, 0, alphasort)) < 0) {
+	bool open() { 
+		if (!m_source->open()) {
 			return false;
 		}
 
-		for (int i = 0; i < n; ++ i) {
-			if (namelist[i]->d_name[0] != '.') {
-				m_data.push_back(Image(m_path + namelist[i]->d_name));
-			}
-			free(namelist[i]);
-		}
-		free(namelist);
-
-		if (m_data.empty()) {
-			throw std::runtime_error("Directory empty, no images opened.");
-		} else {
-			std::cout << "Finished loading " << m_data.size() << " images." << std::endl;
-		}
-
-		m_fullwidth = m_data[0].get_width();
-		m_fullheight = m_data[0].get_height();
+		m_fullwidth = m_source->get_width();
+		m_fullheight = m_source->get_height();
 
 		set_roi(0, 0, m_fullwidth, m_fullheight);
 
@@ -78,26 +78,116 @@ public:
 		return true;
 	}
 
-	bool get_data(Image& img) {
-		struct timespec begin, end;
-		clock_gettime(CLOCK_REALTIME, &begin);
+	bool get_data(Image& img, FrameInfo* info = nullptr) {
+		int64_t begin = monotonic_ns();
+
+		// A paced replay behaves like a camera, the clock keeps going while no
+		// frames are requested and whole exposures are skipped. A free running
+		// one continues where it stopped.
+		int64_t exposure_start = m_clock;
+		int64_t skipped = 0;
+		if (m_speed > 0) {
+			int64_t behind = m_clock_start + (begin - m_real_start) * m_speed - m_clock;
+			int64_t exposure = (int64_t)m_exposure_time * 1000;
+
+			if (m_source->get_timestamp(0) < 0) {
+				if (behind > exposure) {
+					skipped = behind / exposure;
+					exposure_start += skipped * exposure;
+				}
+			} else {
+				int64_t period;
+				while (behind > (period = frame_period(m_frame + skipped))) {
+					behind -= period;
+					exposure_start += period;
+					skipped ++;
+				}
+			}
+		}
+
+		// The skipped exposures are frames that the camera dropped, they are
+		// skipped in the recording too so that it keeps its cadence
+		m_frame += skipped;
+		m_dropped += skipped;
 
-		m_data[m_frame % m_data.size()].get_subarea(img, m_cx, m_cy, m_width, m_height);
+		int64_t exposure_end = exposure_start + frame_period(m_frame);
+		m_clock = exposure_end;
 
+		// A frame that could not be read counts as failed capture
+		const Image* frame = m_source->get(m_frame % m_source->size());
 		m_frame ++;
 
-		clock_gettime(CLOCK_REALTIME, &end);
+		if (frame == nullptr) {
+			return false;
+		}
+		m_captured ++;
+
+		if (m_bin > 1) {
+			// Software emulation of hardware binning
+			frame->get_subarea(m_unbinned, m_cx, m_cy, m_width, m_height);
+			m_unbinned.get_binned(img, m_bin);
+		} else if (m_views && m_cx == 0 && m_width == frame->get_width() && (frame->is_view() || m_source->is_persistent())) {
+			// A ROI of full rows is contiguous in the frame, no copy needed
+			img.set_view(m_width, m_height, frame->m_buffer + (size_t)m_cy * m_width);
+		} else {
+			frame->get_subarea(img, m_cx, m_cy, m_width, m_height);
+		}
+
+		// The exposure of the simulated frame ends after the exposure time
+		if (m_speed > 0) {
+			int64_t delay = m_real_start + (exposure_end - m_clock_start) / m_speed - monotonic_ns();
+
+			if (delay > 0) {
+				std::this_thread::sleep_for(std::chrono::nanoseconds(delay));
+			}
+		}
 
-		long seconds = end.tv_sec - begin.tv_sec;
-		long nanoseconds = end.tv_nsec - begin.tv_nsec;
-		int elapsed = (seconds + nanoseconds*1e-9) * 1e6;
-		int delay = m_exposure_time - elapsed;
+		if (info != nullptr) {
+			info->timestamp = exposure_end;
+			info->exposure = m_exposure_time;
+			info->gain = m_gain;
+			info->roi_x = m_cx;
+			info->roi_y = m_cy;
+			info->roi_width = m_width;
+			info->roi_height = m_height;
+			info->bin = m_bin;
+			info->sequence = m_captured;
+			info->dropped = (int)skipped;
+		}
 
-		std::this_thread::sleep_for(std::chrono::microseconds(delay));
+		// Only a replay in real time has a meaningful latency
+		if (m_speed == 1) {
+			m_latency.add(monotonic_ns() - exposure_end);
+		}
+
+		report();
 
 		return true;
 	}
 
+	// Replay speed relative to the recording, 0 if free running
+	double get_speed() const {
+		return m_speed;
+	}
+
+	// A free running replay must not drop frames, it is only limited by the
+	// speed in which they are processed
+	bool is_realtime() {
+		return m_speed > 0;
+	}
+
+	bool set_bin(int bin) {
+		if (bin < 1 || bin > 4) {
+			return false;
+		}
+		m_bin = bin;
+		return true;
+	}
+
+	int get_bin() {
+		return m_bin;
+	}
+
 	bool start_capture() {
 		return true;
 	}
@@ -110,25 +200,83 @@ public:
 		m_exposure_time = value;
 	}
 
-	void set_gain(int value) {}
+	void set_gain(int value) {
+		m_gain = value;
+	}
 
-	void close() {}
+	bool set_bandwidth(int bandwidth, bool high_speed) {
+		return false;
+	}
+
+	std::string get_name() {
+		return "Virtual Camera";
+	}
+
+	void close() {
+		m_source->close();
+	}
+
+	void allow_views(bool allowed) {
+		m_views = allowed;
+	}
 
 	int get_dropped_frames() { 
-		return 0;
+		return (int)m_dropped;
 	}
 
 	int get_frame() {
-		return m_frame;
+		return m_captured;
 	}
 
 private:
-	std::vector<Image> m_data;
-	std::string m_path;
+	// Time from the end of the previous frame to the end of this one, taken
+	// from the recording if it has timestamps
+	int64_t frame_period(int64_t frame) {
+		int index = frame % m_source->size();
+
+		if (index > 0 && m_source->get_timestamp(index - 1) >= 0) {
+			int64_t period = m_source->get_timestamp(index) - m_source->get_timestamp(index - 1);
+			if (period > 0) {
+				return period;
+			}
+		}
+
+		return (int64_t)m_exposure_time * 1000;
+	}
+
+	// Prints the frame rate achieved since the last report and how much
+	// faster than the recording it is
+	void report() {
+		int64_t now = monotonic_ns();
+		if (now - m_report_time < REPLAY_REPORT_INTERVAL * 1000000000LL) {
+			return;
+		}
+
+		double seconds = (now - m_report_time) * 1e-9;
+		printf("VirtualCamera: replayed %0.1f fps, %0.2fx real time\n",
+			(m_captured - m_report_frame) / seconds, (m_clock - m_report_clock) * 1e-9 / seconds);
+
+		m_report_time = now;
+		m_report_clock = m_clock;
+		m_report_frame = m_captured;
+	}
+
+	FrameSource* m_source;
+	Image m_unbinned;
+	double m_speed;
+	int64_t m_real_start, m_clock_start; // Real and virtual time when the replay started
+	int64_t m_clock; // Virtual time of the end of the last exposure
+	int64_t m_report_time, m_report_clock; // Real and virtual time of the last report
+	int m_report_frame;
 	int m_cx, m_cy, m_width, m_height;
 	int m_fullwidth, m_fullheight;
 	int m_exposure_time;
-	int m_frame;
+	int64_t m_frame; // Index of the next frame of the recording, not wrapped
+	int m_captured; // Frames returned, like a camera counts them
+	int64_t m_dropped; // Exposures skipped to keep up
+	int m_bin;
+	int m_gain;
+	bool m_views; // Frames may refer to the source, see allow_views
 };
 
 #endif // VIRTUAL_CAMERA_HPP
@@ -12,20 +12,28 @@
 #include <thread>
 #include <vector>
 
-WebServer::WebServer(Settings* settings, int port, int version) : m_version(version), m_port(port), m_thread(nullptr) {
+WebServer::WebServer(const std::vector<Settings*>& settings, int port, int version)
+    : m_version(version), m_port(port), m_thread(nullptr), m_settings(settings), m_views(settings.size()) {
   crow::logger::setLogLevel(crow::LogLevel::ERROR);
 
-  CROW_ROUTE(m_app, "/")([settings, this](const crow::request &req) {
+  CROW_ROUTE(m_app, "/")([this](const crow::request &req) {
     crow::mustache::context ctx;
-    ctx["settings"] = settings->serialize();
+    ctx["settings"] = m_settings[camera(req)]->serialize();
     ctx["version"] = m_version;
 
+    // Links to the other cameras, only shown if there is more than one
+    std::vector<crow::json::wvalue> cameras;
+    for (int i = 0; i < m_settings.size() && m_settings.size() > 1; ++i) {
+      cameras.push_back({{"index", i}, {"selected", i == camera(req)}});
+    }
+    ctx["cameras"] = std::move(cameras);
+
     auto page = crow::mustache::load("index.html");
     return page.render(ctx);
   });
 
-  CROW_ROUTE(m_app, "/call/<string>")([settings, this](const crow::request &req, const std::string &key) {
-    auto option = settings->get<OptionButton>(key);
+  CROW_ROUTE(m_app, "/call/<string>")([this](const crow::request &req, const std::string &key) {
+    auto option = m_settings[camera(req)]->get<OptionButton>(key);
     if (option == nullptr) {
       auto resp = crow::response("false");
       resp.set_header("Content-Type", "text/plain");
@@ -37,7 +45,8 @@ WebServer::WebServer(Settings* settings, int port, int version) : m_version(vers
     return resp;
   });
 
-  CROW_ROUTE(m_app, "/set/<string>/<string>")([settings, this](const crow::request &req, const std::string &key, const std::string &value) {
+  CROW_ROUTE(m_app, "/set/<string>/<string>")([this](const crow::request &req, const std::string &key, const std::string &value) {
+    Settings *settings = m_settings[camera(req)];
     auto option = settings->get<Option>(key);
     if (option == nullptr) {
       std::cout << "Setting " << key << " was not found, couldn't apply changes." << std::endl;
@@ -63,21 +72,46 @@ WebServer::WebServer(Settings* settings, int port, int version) : m_version(vers
     return resp;
   });
 
-  CROW_ROUTE(m_app, "/fullimage")([settings, this](const crow::request &req) {
-    auto response = crow::response(m_image.get_encoded_str(100));
+  CROW_ROUTE(m_app, "/fullimage")([this](const crow::request &req) {
+    Image image;
+    FitsHeader header;
+    getCurrentDisplayed(camera(req), image, header);
+
+    auto response = crow::response(image.get_encoded_str(100));
     response.set_header("Content-Type", "image/jpeg");
     return response;
   });
 
-  CROW_ROUTE(m_app, "/info")([settings, this](const crow::request &req) {
-    auto response = crow::response(m_status_text);
-    response.set_header("Content-Type", "text/json");
+  CROW_ROUTE(m_app, "/fits")([this](const crow::request &req) {
+    // encode copies the image, the lock is not held while it is written
+    std::future<std::string> encoded;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      const View &view = m_views[camera(req)];
+      encoded = m_fits.encode(view.image, view.header);
+    }
+
+    std::string data = encoded.get();
+    if (data.empty()) {
+      return crow::response(500, "Failed to encode image");
+    }
+
+    auto response = crow::response(data);
+    response.set_header("Content-Type", "application/fits");
+    response.set_header("Content-Disposition", "attachment; filename=\"image" + std::to_string(camera(req)) + ".fits\"");
+    return response;
+  });
+
+  CROW_ROUTE(m_app, "/info")([this](const crow::request &req) {
+    Settings *settings = m_settings[camera(req)];
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const View &view = m_views[camera(req)];
 
     crow::json::wvalue data;
-    data["status"] = m_status_text;
-    data["stars"] = StarInfo::serializeVector(m_stars, 50);
+    data["status"] = view.status_text;
+    data["stars"] = StarInfo::serializeVector(view.stars, 50);
     data["settings"] = settings->serialize();
-    data["profil"] = m_profile.serialize();
+    data["profil"] = view.profile.serialize();
 
     double deg_per_px = settings->get<OptionNumber>("deg_per_px")->get() / 3600.0;
     double radius_polaris = (settings->get<OptionNumber>("radius_polaris")->get() / 3600.0) / deg_per_px;
@@ -86,8 +120,12 @@ WebServer::WebServer(Settings* settings, int port, int version) : m_version(vers
     data["deg_per_px"] = deg_per_px;
     data["radius_polaris"] = radius_polaris;
     data["deg_polaris"] = deg_polaris;
-    data["pltslv_x"] = m_pltslv_x;
-    data["pltslv_y"] = m_pltslv_y;
+    data["pltslv_x"] = view.pltslv_x;
+    data["pltslv_y"] = view.pltslv_y;
+    data["seeing"] = view.seeing.seeing;
+    data["tau0"] = view.seeing.tau0;
+    data["scintillation"] = view.seeing.scintillation;
+    data["bin"] = view.bin;
 
     return data;
   });
@@ -114,47 +152,82 @@ void WebServer::stop() {
   }
 }
 
-bool WebServer::hasClient() {
-  return m_streamer.hasClient("/image");
+bool WebServer::hasClient(int cam) {
+  return m_streamer.hasClient(topic(cam));
+}
+
+std::string WebServer::topic(int cam) {
+  return cam == 0 ? "/image" : "/image" + std::to_string(cam);
 }
 
-void WebServer::applyData(const Image &img, const std::string &status, const std::vector<StarInfo> &stars, bool calculateProfile) {
+int WebServer::camera(const crow::request &req) const {
+  const char *cam = req.url_params.get("cam");
+  int index = cam != nullptr ? std::atoi(cam) : 0;
+
+  return index >= 0 && index < m_settings.size() ? index : 0;
+}
+
+void WebServer::applyData(int cam, const Image &img, const std::string &status, const std::vector<StarInfo> &stars, bool calculateProfile) {
+  View &view = m_views[cam];
 
   // Save resources by only encoding and publishing when client is available
-  if (this->hasClient()) {
+  if (this->hasClient(cam)) {
 
     // Returns current time used to limit framerate
-    static auto last = std::chrono::high_resolution_clock::now();
     auto now = std::chrono::high_resolution_clock::now();
     std::chrono::milliseconds fps(1000 / 10); // limit frame rate to 10 FPS
 
     // if faster than 10 FPS, slow down
-    if (now - last < fps) {
-      std::this_thread::sleep_for(fps - (now - last));
+    if (now - view.last < fps) {
+      std::this_thread::sleep_for(fps - (now - view.last));
     }
-    last = now;
+    view.last = now;
 
     // Publish the image, with 75% JPEG Quality level
-    m_streamer.publish("/image", img.get_encoded_str(75));
+    m_streamer.publish(topic(cam), img.get_encoded_str(75));
   }
 
+  std::lock_guard<std::mutex> lock(m_mutex);
+
   // Store copy of image for /fullimage Route
-  m_image.copy_from(img);
+  view.image.copy_from(img);
 
   // Copy stars and status information
-  m_status_text = status;
-  m_stars = stars;
+  view.status_text = status;
+  view.stars = stars;
 
   // Calculate Starprofil if set to true
   if (calculateProfile) {
-    m_profile.set_from_image(img);
+    view.profile.set_from_image(img);
   } else {
-    m_profile.first.clear();
-    m_profile.second.clear();
+    view.profile.first.clear();
+    view.profile.second.clear();
   }
 }
 
-void WebServer::setPlateSolveData(double x, double y) {
-  m_pltslv_x = x;
-  m_pltslv_y = y;
+void WebServer::setImageHeader(int cam, const FitsHeader &header) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_views[cam].header = header;
+}
+
+void WebServer::getCurrentDisplayed(int cam, Image &image, FitsHeader &header) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  image.copy_from(m_views[cam].image);
+  header = m_views[cam].header;
+}
+
+void WebServer::setPlateSolveData(int cam, double x, double y) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_views[cam].pltslv_x = x;
+  m_views[cam].pltslv_y = y;
+}
+
+void WebServer::setSeeingData(int cam, const SeeingResult &result) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_views[cam].seeing = result;
+}
+
+void WebServer::setBinning(int cam, int bin) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_views[cam].bin = bin;
 }
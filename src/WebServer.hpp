@@ -1,37 +1,80 @@
 #ifndef WEBSERVER_HPP
 #define WEBSERVER_HPP
 
+#include "FitsWriter.hpp"
 #include "Image.hpp"
 #include "Settings.hpp"
 #include "Profil.hpp"
 #include "util.hpp"
+#include "Seeing.hpp"
 #include "mjpeg_streamer.hpp"
 
 
 #include <crow.h>
+#include <chrono>
 #include <mutex>
 #include <thread>
 #include <unordered_set>
 
 class WebServer {
 public:
-	WebServer(Settings* settings, int socket, int version);
+	// One settings object per camera, the cameras are selected with the
+	// "cam" parameter of every route and have their own MJPEG topic
+	WebServer(const std::vector<Settings*>& settings, int socket, int version);
 
 	void run();
 
 	void stop();
 
-	void applyData(const Image& img, const std::string& status, const std::vector<StarInfo>& stars, bool calculateProfile);
+	void applyData(int cam, const Image& img, const std::string& status, const std::vector<StarInfo>& stars, bool calculateProfile);
 
-	void setPlateSolveData(double x, double y);
+	void setPlateSolveData(int cam, double x, double y);
 
-	const Image& getCurrentDisplayedImage() const { return m_image; }
+	void setSeeingData(int cam, const SeeingResult& result);
 
-	bool hasClient();
+	void setBinning(int cam, int bin);
+
+	// FITS keywords of the frame that is displayed next
+	void setImageHeader(int cam, const FitsHeader& header);
+
+	// Copies the displayed picture and its metadata
+	void getCurrentDisplayed(int cam, Image& image, FitsHeader& header) const;
+
+	bool hasClient(int cam);
+
+	// MJPEG topic of a camera, "/image" for the first one and "/image<cam>" for the others
+	static std::string topic(int cam);
 
 private:
+	// Everything the website shows for one camera
+	struct View {
+		Image image; 		 // Displayed picture
+		FitsHeader header;	 // Metadata of the picture for the /fits route
+		Profil profile; 	 // The information used to create a diagram for the star profile
+
+		// Information for the website, set via applyData methode
+		std::string status_text;
+		std::vector<StarInfo> stars;
+
+		// PlateSolving information, set via setPlateSolveData
+		double pltslv_x = 0;
+		double pltslv_y = 0;
+
+		// Latest successful seeing measurement, set via setSeeingData
+		SeeingResult seeing;
+
+		// Bin factor of the displayed image, star coordinates are unbinned
+		int bin = 1;
+
+		// Time of the last published frame, used to limit the frame rate
+		std::chrono::high_resolution_clock::time_point last;
+	};
+
 	static void exec(WebServer* server);
 
+	// Camera index from the "cam" parameter, the first camera if missing or invalid
+	int camera(const crow::request& req) const;
+
 	int m_port, m_version;
 
     nadjieb::MJPEGStreamer m_streamer;
@@ -39,17 +82,11 @@ private:
 
 	std::thread *m_thread;
 
-	Image m_image; 		 // Displayed picture
-	Profil m_profile; 	 // The information used to create a diagram for the star profile
-
-	// Information for the website, set via applyData methode
-	std::string m_status_text;
-	std::string m_indicators;
-	std::vector<StarInfo> m_stars;
+	std::vector<Settings*> m_settings;
+	std::vector<View> m_views;
+	mutable std::mutex m_mutex; // Guards the views, the routes run on the threads of crow
 
-	// PlateSolving information, set via setPlateSolveData
-    double m_pltslv_x = 0;
-    double m_pltslv_y = 0;
+	FitsWriter m_fits; // Encodes the images of the /fits route
 };
 
 #endif // WEBSERVER_HPP
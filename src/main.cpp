@@ -1,4 +1,5 @@
 #include "ASICamera2.h"
+#include "SyntheticCamera.hpp"
 #include "VirtualCamera.hpp"
 #include "WebServer.hpp"
 #include "Settings.hpp"
@@ -30,6 +31,8 @@
 #include "fitsio2.h"
 
 #include "AsiCamera.hpp"
+#include "Pipeline.hpp"
+#include "ThreadPool.hpp"
 #include "util.hpp"
 #include "Image.hpp"
 
@@ -38,35 +41,17 @@
 #define PORT 8080
 
 #define DEVICE_NAME "/dev/ttyUSB0"
-#define ASTAP_PROGRAM "/home/daniel/Documents/Diploma/astap_command-line_version_Linux_amd64/astap_cli"
-#define ASTAP_DATABASE "/home/daniel/Documents/Diploma/astap_command-line_version_Linux_amd64/h18"
-
-// Helper definitions that convert from radians to degrees and vice versa
-#define rad(deg) ((deg)*(M_PI/180.0))
-#define deg(rad) ((rad)*(180.0/M_PI))
 
 static WebServer* server = nullptr;
-static Camera* camera = nullptr;
 static SerialManager* serial = nullptr;
-static Settings* settings = nullptr;
+static ThreadPool* pool = nullptr;
+static std::vector<Pipeline*> pipelines;
 
 // Prototypes
-std::string btn_platesolving();
 std::string btn_shutdown();
 std::string btn_download_image();
 std::string btn_download_log();
 
-typedef enum {
-	M_AVERAGE,
-	M_CORRELATION,
-	M_FWHM,
-} MeasureMode;
-
-typedef enum {
-	C_SEARCH,
-	C_CALCULATE,
-} CaptureMode;
-
 int loadVersion() {
   std::ifstream input("./VERSION");
   int version;
@@ -83,8 +68,8 @@ int loadVersion() {
 
 void signalHandler(int signum) {
 	// Free memory & exit
-	if (camera != nullptr)
-		camera->close();
+	for (Pipeline* pipeline : pipelines)
+		pipeline->close();
 	if (server != nullptr)
 		server->stop();
 	if (serial != nullptr)
@@ -93,164 +78,6 @@ void signalHandler(int signum) {
 	exit(0);
 }
 
-double measure_star(Image& frame, const StarInfo& star, int area) {
-	const int measurements = settings->get<OptionNumber>("measurements")->get();
-	const int measure_mode = settings->get<OptionMode>("measure_mode")->get();
-
-	std::vector<Image> frames;
-
-	// Set region of interest
-	int roi_x = star.x()-area/2.0;
-	int roi_y = star.y()-area/2.0;
-	camera->set_roi(roi_x, roi_y, area, area);
-
-	// Start capturing data
-	camera->start_capture();
-	for (int i = 0; i < measurements; ++ i) {
-		Image img;
-		camera->get_data(img);
-		frames.push_back(img);
-
-	    server->applyData(img, "Capturing Frame " + std::to_string(i) + " of " + std::to_string(measurements), {}, true);
-	}
-	camera->stop_capture();
-	std::cout << "Captured frames, dropped: " << camera->get_dropped_frames() << std::endl;
-
-	// Calculating seeing from frames
-	double seeing;
-	switch (measure_mode) {
-	case M_AVERAGE:
-		seeing = calculate_seeing_average(frames);
-		break;
-	case M_CORRELATION:
-		seeing = calculate_seeing_correlation(frames);
-		break;
-	case M_FWHM:
-		seeing = calculate_seeing_fwhm(frames);
-		break;
-	default:
-		seeing = 0;
-	}
-	printf("Took %d images and calculated: seeing = %0.4f\n", measurements, seeing);
-
-	// Return latest frame for displaying in webinterface 
-	frame.copy_from(frames[measurements-1]);
-
-	return seeing;
-}
-
-bool astap_solve(double& ra, double& dc) {
-	std::string buffer;
-
-	server->getCurrentDisplayedImage().save_fits("temp.fits");
-	std::cout << "Saved temp.fits for ASTAP and starting ASTAP" << std::endl;
-
-	if (fork() == 0) {
-		// runs command: ./astap_cli -d h18 -f file.fits -ra 3h -spd 180 -s 50 -m 4
-		execlp(ASTAP_PROGRAM, "astap", "-f", "temp.fits", "-d", ASTAP_DATABASE, "-ra", "3h", "-spd", "180", "-s", "50", nullptr);
-	} else {
-		wait(nullptr);
-		std::cout << "ASTAP process finished" << std::endl;
-		std::ifstream file("temp.ini");
-		if (!file.is_open()) {
-			std::cout << "No temp.ini file found!" << std::endl;
-			return false;
-		}
-
-		// Check if platesolving was successful
-		goToLine(file, 2);
-		file >> buffer;
-		if (buffer.compare("PLTSOLVD=F") == 0) {
-			std::cout << "ASTAP exited with error" << std::endl;
-			file.close();
-			return false;
-		}
-
-		goToLine(file, 4);
-		file.seekg(8, std::ios::cur);
-		file >> ra;
-
-		goToLine(file, 5);
-		file.seekg(8, std::ios::cur);
-		file >> dc;
-
-		file.close();
-
-		std::cout << "Extracted ra: " << ra << " and dc: " << dc << std::endl;
-
-		// Convert to different format
-		ra = (24.0 / 360.0) * ra;
-	}
-
-	return true;
-}
-
-
-/**
- * This function calculates the azimuth and altitude of a celestial body given its right ascension, declination,
- * and the latitude and local mean sidereal time at the observer's location.
- *
- * Parameters:
- *  lmst: Local mean sidereal time at the observer's location in degrees.
- *  rightAscension: Right ascension of the celestial body in degrees.
- *  declination: Declination of the celestial body in degrees.
- *  latitude: Latitude of the observer's location in degrees.
- *  azimuth: Output parameter for the calculated azimuth in degrees.
- *  altitude: Output parameter for the calculated altitude in degrees.
- */
-void get_azimut_and_height(double lmst, double rightAscension, double declination, double latitude, double& azimuth, double& altitude) {
-  double phi = rad(latitude);
-  double tau = rad(15 * (lmst - rightAscension));
-  double delta = rad(declination);
-
-  azimuth = deg(atan(sin(tau)/(sin(phi)*cos(tau)-cos(phi)*tan(delta))));
-  altitude = deg(asin(sin(phi)*sin(delta) + cos(phi)*cos(delta)*cos(tau)));
-}
-
-/* 
- * Returns false if star is to close to the edge of the image, because this
- * can cause issues since the algorithm would look for pixels outside of
- * the bounds, which could lead to crashes or undefined beahviour.
- */
-bool is_star_outside_box(const Image& img, StarInfo& star, int area) {
-	int space = area/2;
-	bool bottomright = star.x() > img.get_width() - space || star.y() > img.get_height() - space;
-	bool topleft = star.x() < space || star.y() < space;
-
-	return bottomright || topleft;
-}
-
-int auto_gain(StarInfo& star, int area, int threshold, int star_size_min, int gain) {
-	/// Set region of interest ///
-	int roi_x = star.x()-area/2.0;
-	int roi_y = star.y()-area/2.0;
-	printf("Setting roi %s\n", camera->set_roi(roi_x, roi_y, area, area) ? "success" : "failed");
-
-	/// Start capturing data ///
-	printf("START capturing frames\n");
-
-	struct timespec begin, end;
-	clock_gettime(CLOCK_REALTIME, &begin);
-
-	std::vector<StarInfo> stars;
-	Image frame;
-	double x, y;
-
-	do {
-		gain -= 50;
-		if (gain < 0) {
-			gain = 0;
-		}
-
-		camera->set_gain(gain);
-		camera->start_capture();
-		camera->get_data(frame);
-		camera->stop_capture();
-	} while (gain > 0 && calculate_centroid(frame, 0, 0, area, x, y) == 0.0);
-
-	return gain;
-}
-
 std::string btn_shutdown() {
 	execlp("/bin/shutdown", "shutdown", "-r", "now", nullptr);
 	return "Restarting, WebInterface will be unavailable during restart.";
@@ -262,38 +89,6 @@ std::string btn_download_image() {
 	return "Creating download link..."; 
 }
 
-
-std::string btn_platesolving() {
-	double rightAscension, declination;
-	if (!astap_solve(rightAscension, declination)) {
-		return "Failed to solve image";
-	}
-
-	double longitude = settings->get<OptionNumber>("longitude")->get();
-	double latitude = settings->get<OptionNumber>("latitude")->get();
-	double lmst = get_siderial_time(longitude);
-
-	// Current image center
-	double azimuth, altitude;
-	get_azimut_and_height(lmst, rightAscension, declination, latitude, azimuth, altitude);
-
-	// Difference in pixel
-	double degPerPx = settings->get<OptionNumber>("deg_per_px")->get() / 3600.0;
-	double diffX = (azimuth-0)/degPerPx;
-	double diffY = (altitude-latitude)/degPerPx;
-
-	server->setPlateSolveData(diffX, diffY);
-
-	std::stringstream ss;
-
-	ss << "rekta: " << rightAscension << std::endl;
-	ss << "dekli: " << declination << std::endl;
-	ss << "delta azimuth: " << azimuth << std::endl;
-	ss << "delta altitude: " << (altitude-latitude) << std::endl;
-
-	return ss.str();
-}
-
 std::string btn_download_log() {
 	system("journalctl -u seeing -S today > seeing.log");
 	std::cout << "journalctl process finished" << std::endl;
@@ -306,240 +101,168 @@ std::string btn_download_log() {
 	return data;
 }
 
-struct Comma final : std::numpunct<char> {
-    char do_decimal_point() const override { return ','; }
-};
-
-bool store_seeing(double seeing) {
-	auto t = std::time(nullptr);
-    auto tm = *std::localtime(&t);
-
-    std::ostringstream date, time;
-    date << std::put_time(&tm, "%y%m%d");
-    time << std::put_time(&tm, "%H:%M");
-
-	std::ofstream out("./measurements/SE" + date.str() + ".dat", std::ios_base::app);
-    out.imbue(std::locale(std::locale::classic(), new Comma));
-
-	if (!out.is_open()) {
-		return false;
-	}
-
-	char data[40];
-	int len = sprintf(data, "%s\t%.2f\r\n", time.str().c_str(), seeing);
-
-	out.write(data, len);
-	out.close();
-
-	return true;
-}
-
-int main(int argc, char** argv) {
-	// Changes working directory if WD (Working Directory) environment was set
-	chdir(getenv("WD"));
+// Every camera has its own settings, stored in settings.txt for the first one
+// and settings<index>.txt for the others
+Settings* create_settings(int index) {
+	std::string filename = index == 0 ? cfg_filename : "settings" + std::to_string(index) + ".txt";
 
-	// Load the version from the "VERSION" file
-	const int VERSION = loadVersion();
-
-	// Apply Settings, has to be after chdir otherwise it cannot find the settings->txt file
-	settings = new Settings({
+	return new Settings({
 		{"capture_mode", new OptionMode("Discover Stars", "Capture mode", C_SEARCH, {"Search stars", "Calculate seeing"})},
 		{"star_size", new OptionNumber("Discover Stars", "Minimum star area (px)", 50, 1, 1000, 1)}, 	// Minimum size of a star to count
 		{"exposure", new OptionNumber("Discover Stars", "Exposure (ms)", 10, 0, 10000, 1)},
 		{"gain", new OptionNumber("Discover Stars", "Gain", 300, 0, 480, 1)},
 		{"min_threshold", new OptionNumber("Discover Stars", "Minimum Threshold", 100, 1, 255, 1)},
 		{"v_threshold", new OptionBool("Discover Stars", "Visualize Threshold", false)},
+		{"search_bin", new OptionMode("Discover Stars", "Binning in search mode", 0, {"1x1", "2x2", "3x3", "4x4"})},
 		{"measure_mode", new OptionMode("Seeing", "Seeing-calculation type", M_AVERAGE, {"Average", "Correlation", "FWHM"})},
 		{"roi", new OptionNumber("Seeing", "Region of interest (px)", 128, 32, 512, 32)},
+		{"auto_exposure", new OptionBool("Seeing", "Automatic gain and exposure", false)}, 	// Exposure and gain settings are used as upper limits
+		{"target_peak", new OptionNumber("Seeing", "Target peak (ADU)", 180, 50, 250, 1)},
 		{"pause", new OptionNumber("Seeing", "Pause (s)", 5, 0, 60 * 60, 1)},
 		{"measurements", new OptionNumber("Seeing", "Measurments per Seeing", 10, 3, 10000, 1)}, 		// Amount of measurements per seeing value
-		{"btn_solving", new OptionButton("Calibrate Telescope", "Plate solving", btn_platesolving)},
+		{"min_valid", new OptionNumber("Seeing", "Minimum valid frames (%)", 50, 0, 100, 1)}, 		// Bursts with less valid frames are rejected
+		{"follow_drift", new OptionBool("Seeing", "Move ROI with drifting star", true)},
+		{"adaptive", new OptionBool("Seeing", "Stop burst when converged", false)},
+		{"min_measurements", new OptionNumber("Seeing", "Minimum measurments per Seeing", 50, 3, 10000, 1)}, 	// Only used when stopping converged bursts
+		{"precision", new OptionNumber("Seeing", "Target precision (%)", 5, 1, 100, 1)}, 				// Relative standard error at which a burst is converged
+		{"record_bursts", new OptionBool("Seeing", "Record bursts to SER files", false)}, 				// Stored in ./recordings
+		{"archive_fits", new OptionBool("Seeing", "Archive a FITS frame per seeing value", false)}, 		// Stored in ./recordings
+		{"flight_seconds", new OptionNumber("Seeing", "Keep recent frames (s)", 10, 1, 600, 1)}, 		// Dumped to ./recordings when something fails
+		{"dump_seeing", new OptionNumber("Seeing", "Dump recent frames above seeing", 0, 0, 100)}, 	// 0 disables the dump on bad seeing
+		{"btn_dump", new OptionButton("Seeing", "Dump recent frames", [index] { return pipelines[index]->btn_dump(); })},
+		{"btn_solving", new OptionButton("Calibrate Telescope", "Plate solving", [index] { return pipelines[index]->btn_platesolving(); })},
 		{"longitude", new OptionNumber("Calibrate Telescope", "Longitude", 16.57736, -180, 180)},
 		{"latitude", new OptionNumber("Calibrate Telescope", "Latitude", 48.31286, -90, 90)},
 		{"deg_per_px", new OptionNumber("Calibrate Telescope", "Arcsec per Pixel", 5.76, 0, 20)},
 		{"radius_polaris", new OptionNumber("Calibrate Telescope", "Radius of Polaris orbit (Arcsec)", 2400, 0, 10000)},
+		{"auto_bandwidth", new OptionBool("Other", "Tune USB bandwidth", true)},
 		{"btn_shutdown", new OptionButton("Other", "Restart Computer", btn_shutdown)},
 		{"btn_download_image", new OptionButton("Other", "Save current image", btn_download_image)},
 		{"btn_download_log", new OptionButton("Other", "Save log files", btn_download_log)},
-	});
+	}, filename);
+}
 
+int main(int argc, char** argv) {
+	// Changes working directory if WD (Working Directory) environment was set
+	chdir(getenv("WD"));
 
-	// Start the webserver
-	server = new WebServer(settings, PORT, VERSION);
-	server->run();
+	// Load the version from the "VERSION" file
+	const int VERSION = loadVersion();
 
-	// Start the serial communication
-	serial = new SerialManager(DEVICE_NAME);
-	serial->listen();
-	
+	// Decoding of recorded images and the analysis of all cameras share one pool
+	pool = new ThreadPool();
+
+	// Every path given as argument is opened as virtual camera, without
+	// arguments all connected asi cameras are used. Paths with the prefix
+	// "stream:" are read from disk while replaying instead of decoding all
+	// images up front, "mmap:" additionally maps the files ahead.
+	// "synthetic:<options>" renders frames instead, see SyntheticConfig.
+	// SER and FITS files are memory mapped and replayed frame by frame.
+	// "--replay=<speed>" replays N times faster than recorded, "--replay=max"
+	// as fast as the frames are processed.
+	double speed = 1;
+	std::vector<std::string> paths;
+	for (int i = 1; i < argc; ++ i) {
+		std::string arg = argv[i];
+		if (arg.rfind("--replay=", 0) == 0) {
+			speed = arg.substr(9) == "max" ? 0 : std::max(atof(arg.substr(9).c_str()), 0.001);
+		} else {
+			paths.push_back(arg);
+		}
+	}
 
-	// Add signal handler, does the exit on ctrl+c thingy
-	std::signal(SIGTERM, signalHandler);
-	std::signal(SIGINT, signalHandler);
+	std::vector<Camera*> cameras;
+	if (!paths.empty()) {
+		for (const std::string& path : paths) {
+			FrameSource* source;
+
+			if (path.rfind("synthetic:", 0) == 0) {
+				cameras.push_back(new SyntheticCamera(path.substr(10)));
+				continue;
+			}
 
+			std::string extension = path.substr(path.rfind('.') + 1);
+			std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+			if (extension == "ser") {
+				source = new SerSource(path);
+			} else if (extension == "fits" || extension == "fit" || extension == "fts") {
+				source = new FitsCubeSource(path);
+			} else if (path.rfind("stream:", 0) == 0) {
+				source = new LazyDirectorySource(path.substr(7));
+			} else if (path.rfind("mmap:", 0) == 0) {
+				source = new LazyDirectorySource(path.substr(5), true);
+			} else {
+				source = new EagerDirectorySource(path, pool);
+			}
 
-	// Open asi camera, or if a path was provided the virtual camera
-	int retry_count = 3;
-	if (argc >= 2) {
-		camera = new VirtualCamera(argv[1]);
+			cameras.push_back(new VirtualCamera(source, speed));
+		}
 	} else {
 		while (AsiCamera::get_num_of_cameras() <= 0) {
 			std::cout << "No cameras available, trying again in 10s ..." << std::endl;
 			sleep(10);
 		}
-		camera = new AsiCamera(0);
+		// The SDK addresses cameras by their ID, which is not the index once
+		// a camera was unplugged
+		for (int i = 0; i < AsiCamera::get_num_of_cameras(); ++ i) {
+			ASI_CAMERA_INFO info;
+			if (ASIGetCameraProperty(&info, i) != ASI_SUCCESS) {
+				std::cout << "Failed to query camera " << i << std::endl;
+				continue;
+			}
+			cameras.push_back(new AsiCamera(info.CameraID));
+		}
 	}
 
-	if (!camera->open()) {
-		std::cerr << "Failed to open Camera" << std::endl;
-		return EXIT_FAILURE;
+	// Apply Settings, has to be after chdir otherwise it cannot find the settings files
+	std::vector<Settings*> settings;
+	for (int i = 0; i < cameras.size(); ++ i) {
+		settings.push_back(create_settings(i));
 	}
 
-	// Get camera resolution
-	int width, height;
-	camera->get_fullsize(width, height);
-	std::cout << "Camera resolution: " << width << "x" << height << std::endl;
+	// The buttons of the webinterface call into the pipelines, so all of them
+	// exist before it is started
+	server = new WebServer(settings, PORT, VERSION);
 
-	// Temporary variables
-	std::stringstream status;
-	std::vector<StarInfo> stars;
-	Image img;
+	// Start the serial communication
+	serial = new SerialManager(DEVICE_NAME);
+	serial->listen();
+
+	// The serial display shows the seeing of the first camera
+	for (int i = 0; i < cameras.size(); ++ i) {
+		pipelines.push_back(new Pipeline(i, cameras[i], settings[i], server, i == 0 ? serial : nullptr, pool));
+	}
+
+	// Start the webserver
+	server->run();
 
 	// Add signal handler, does the exit on ctrl+c thingy
 	std::signal(SIGTERM, signalHandler);
 	std::signal(SIGINT, signalHandler);
 
-    auto lastTime = std::chrono::high_resolution_clock::now();
-
-	// Start main loop
-	while (true) {
-		stars.clear();
-		status.str("");
-		status.clear();
-
-		// Get settings
-		const int star_size_min = settings->get<OptionNumber>("star_size")->get();
-		const int capture_mode = settings->get<OptionMode>("capture_mode")->get();
-		const int show_threshold = settings->get<OptionBool>("v_threshold")->get();
-		const int min_threshold = settings->get<OptionNumber>("min_threshold")->get();
-		const int exposure = settings->get<OptionNumber>("exposure")->get() * 1000; // stored as ms but used as us
-		const int gain = settings->get<OptionNumber>("gain")->get();
-		const int area = settings->get<OptionNumber>("roi")->get();
-
-		const auto nowTime = std::chrono::high_resolution_clock::now();
-
-		if (!server->hasClient() && capture_mode == C_SEARCH) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	// A camera that fails to open is left out, the others keep working
+	int running = 0;
+	for (Pipeline* pipeline : pipelines) {
+		if (!pipeline->open()) {
+			std::cerr << "Failed to open Camera " << pipeline->get_index() << ", skipping it" << std::endl;
 			continue;
 		}
 
-		camera->set_roi(0, 0, width, height);
-		camera->set_exposure(exposure);
-		camera->set_gain(gain);
-
-
-		// Find biggest star
-		camera->start_capture();
-		camera->get_data(img);
-		camera->stop_capture();
-
-		status << "Master frame: " << camera->get_frame() << std::endl;
-
-		const int threshold = std::max(calculate_threshold(img), min_threshold);
-		status << "Threshold: " << threshold << std::endl;
-
-		const int count = findStars(img, stars, threshold, star_size_min);
-		status << "Star count: " << count << std::endl;
-
-		if (show_threshold && capture_mode == C_SEARCH) {
-			visualize_threshold(img, threshold);
-		}
-
-		// In case no stars were found, retry
-		if (count <= 0) {
-			server->applyData(img, status.str(), stars, false);
-
-			if (nowTime > lastTime + std::chrono::seconds(10)) {
-				printf("Found %d stars with threshold %d\n", count, threshold);
-				printf("Master frame: %d\n", camera->get_frame());
-				lastTime = nowTime;
-			}
-
-			continue;
-		}
-
-		// Sort stars, first element is the biggest star
-		std::sort(stars.begin(), stars.end(), sort_stars);
-
-		status << "Brightest star: [ x:" << stars[0].x() << ", y:" << stars[0].y() << ", area:" << stars[0].area << ", d:" << stars[0].diameter() << " ]" << std::endl;
-
-		if (nowTime > lastTime + std::chrono::seconds(10)) {
-			printf("Found %d stars with threshold %d\n", count, threshold);
-			printf("Brightest star [ a: %dpx, d: %0.2fpx, x: %0.2f, y: %0.2f ]\n", stars[0].area, stars[0].diameter(), stars[0].x(), stars[0].y());
-			printf("Master frame: %d, dim: %d, %d\n", camera->get_frame(), img.get_width(), img.get_height());
-			lastTime = nowTime;
-		}
-
-
-		/// No need to continue if in capture_mode SEARCH as we do not need to calculate seeing ///
-		if (capture_mode == C_SEARCH) {
-			server->applyData(img, status.str(), stars, false);
-			continue;
-		}
-
-		/// Search for a viable star
-		Image latestFrame;
-		double seeing = 0;
-		int i;
-
-		for (i = 0; i < stars.size(); ++ i) {
-
-			// Skip star if to close to edge
-			if (is_star_outside_box(img, stars[i], area)) {
-				std::cout << "Skipping star " << i << " to close on edge" << std::endl;	
-				continue;
-			}
-
-			// If it fails to calculate centroid of star, we will skip it too
-			double _x, _y;
-			if (settings->get<OptionMode>("measure_mode")->get() == M_AVERAGE && calculate_centroid(img, stars[i].x()-area, stars[i].y()-area, area, _x, _y) == 0.0) {
-				std::cout << "Skipping star " << i << " failed to calculate centroid" << std::endl;
-				continue;
-			}
-
-			// Try to calculate seeing value
-			seeing = measure_star(latestFrame, stars[i], area);
-
-			// if we got our value we can exit the loop
-			if (seeing != 0) {
-				break;
-			}
-
-			// if seeing is zero it failed to calculate seeing
-			std::cout << "Skipping star " << i << " overexposured" << std::endl;
-		}
-
-		// Serial update send seeing
-		status << "Seeing on Star" << i << ": " << seeing << std::endl;
-		server->applyData(latestFrame, status.str(), stars, true);
-
-		if (seeing > 0) {
-			serial->send_seeing(seeing);
-			store_seeing(seeing);
-		}
+		pipeline->run();
+		running += 1;
+	}
 
-		// Sleep to not constantly make measurements using the pause setting from the webinterface
-		for (int i = settings->get<OptionNumber>("pause")->get(); i > 0 && !settings->m_changed; -- i) {
-			std::this_thread::sleep_for(std::chrono::seconds(1));
-			if (server->hasClient()) {
-				server->applyData(latestFrame, status.str() + "Sleep Timeout: " + std::to_string(i-1) + "s", stars, true);
-			}
-		}
+	if (running == 0) {
+		std::cerr << "No camera could be opened" << std::endl;
+		server->stop();
+		serial->stop();
+		return EXIT_FAILURE;
+	}
 
-		if (settings->m_changed) {
-			settings->m_changed = false;
-			continue;
-		}
+	// The pipelines run until the process is terminated
+	for (Pipeline* pipeline : pipelines) {
+		pipeline->stop();
 	}
 
 	return 0;
@@ -30,16 +30,17 @@ bool SerialManager::open_uart(const std::string& device) {
 }
 
 
-void SerialManager::send_seeing(double seeing) {
+void SerialManager::send_seeing(double seeing, double scintillation) {
 	m_seeing.push_back(seeing);
+	m_scintillation.push_back(scintillation);
 }
 
-double SerialManager::get_avg_seeing() {
-	double sum_seeing = 0;
-	for (auto& seeing : m_seeing) {
-		sum_seeing += seeing;
+double SerialManager::get_average(const std::vector<double>& values) {
+	double sum = 0;
+	for (auto& value : values) {
+		sum += value;
 	}
-	return sum_seeing / (double)m_seeing.size();
+	return sum / (double)values.size();
 }
 
 void SerialManager::exec(SerialManager* serial) {
@@ -57,7 +58,7 @@ void SerialManager::exec(SerialManager* serial) {
 			std::cout << "Send-Data-Request recv from SQM" << std::endl;
 			if (!serial->m_seeing.empty()) {
 				memset(buffer, 0, sizeof(buffer));
-				len = sprintf(buffer, "%03f\r\n", serial->get_avg_seeing()); 
+				len = sprintf(buffer, "%03f\r\n", get_average(serial->m_seeing)); 
 				serial->m_seeing.clear();
 
 				std::cout << "Send seeing value: " << buffer << std::endl;
@@ -65,6 +66,18 @@ void SerialManager::exec(SerialManager* serial) {
 			} else {
 				std::cout << "No data to be send" << std::endl;
 			}
+		} else if (len == 6 && std::memcmp(buffer, "scin", 4) == 0) {
+			std::cout << "Send-Scintillation-Request recv from SQM" << std::endl;
+			if (!serial->m_scintillation.empty()) {
+				memset(buffer, 0, sizeof(buffer));
+				len = sprintf(buffer, "%03f\r\n", get_average(serial->m_scintillation));
+				serial->m_scintillation.clear();
+
+				std::cout << "Send scintillation value: " << buffer << std::endl;
+				write(serial->m_fd, buffer, len);
+			} else {
+				std::cout << "No data to be send" << std::endl;
+			}
 		} else {
 			std::cout << "[SERIAL] No match, read in " << len <<  " bytes: " << buffer << std::endl;
 		}
@@ -17,14 +17,14 @@ public:
 
 	void stop();
 
-	void send_seeing(double seeing);
+	void send_seeing(double seeing, double scintillation);
 
 private:
 	int set_interface_attribs(int fd, int speed, int parity);
 
 	void set_blocking(int fd, int should_block);
 
-	double get_avg_seeing();
+	static double get_average(const std::vector<double>& values);
 
 	static void exec(SerialManager* serial);
 
@@ -35,6 +35,8 @@ private:
 	int m_fd;
 
 	std::vector<double> m_seeing;
+
+	std::vector<double> m_scintillation;
 };
 
 #endif // SERIAL_H
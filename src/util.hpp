@@ -4,6 +4,7 @@
 #include "Image.hpp"
 #include "Profil.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <crow/json.h>
@@ -47,6 +48,12 @@ struct StarInfo {
     area = 0;
   }
 
+  // Maps a star found on a binned frame back to unbinned pixels
+  StarInfo scaled(int bin) const {
+    return StarInfo{max_x * bin + bin - 1, min_x * bin, max_y * bin + bin - 1,
+                    min_y * bin, area * bin * bin};
+  }
+
   float radius() const { return std::sqrt(area / M_PI); }
 
   float diameter() const { return radius() * 2; }
@@ -214,6 +221,30 @@ inline void visualize_threshold(Image &img, int threshold) {
   }
 }
 
+#define SATURATION_LEVEL 255
+
+/*
+ * Counts the clipped pixels inside the bounding box of the star, with a small
+ * margin around it. Used to reject overexposured stars on the master frame
+ * before capturing a whole burst of them.
+ */
+inline int count_saturated(const Image &img, const StarInfo &star, int margin = 2) {
+  int start_x = std::max(star.min_x - margin, 0);
+  int start_y = std::max(star.min_y - margin, 0);
+  int end_x = std::min(star.max_x + margin, img.get_width() - 1);
+  int end_y = std::min(star.max_y + margin, img.get_height() - 1);
+
+  int count = 0;
+  for (int y = start_y; y <= end_y; ++y) {
+    const uint8_t *row = img.m_buffer + y * img.get_width();
+    for (int x = start_x; x <= end_x; ++x) {
+      count += row[x] >= SATURATION_LEVEL;
+    }
+  }
+
+  return count;
+}
+
 inline bool sort_stars(const StarInfo &i1, const StarInfo &i2) {
   return i1.area > i2.area;
 }
@@ -382,132 +413,6 @@ inline double calculate_centroid(const Image &img, double sx, double sy,
   return mass;
 }
 
-inline double calculate_seeing_correlation(std::vector<Image> &frames) {
-  /// Calculate coordinates ///
-  double cx, cy, avg_x, avg_y;
-  double mass;
-
-  int count = 0;
-
-  std::vector<double> x_positions;
-  std::vector<double> y_positions;
-
-  for (const Image &frame : frames) {
-    mass = calculate_centroid(frame, 0, 0, frame.get_width(), cx, cy);
-
-    if (mass <= 0.0) {
-      return 0;
-    } else {
-      x_positions.push_back(cx);
-      y_positions.push_back(cy);
-      avg_x += cx;
-      avg_y += cy;
-      count++;
-    }
-  }
-  avg_x /= count;
-  avg_y /= count;
-
-  if (count < frames.size() / 2) {
-    printf("Too many frames failed to calculate centroid\n");
-    return 0;
-  }
-
-  double s_xx = 0, s_yy = 0, s_xy = 0;
-  for (int i = 0; i < count; ++i) {
-    s_xy += (x_positions[i] - avg_x) * (y_positions[i] - avg_y);
-    s_xx += (x_positions[i] - avg_x) * (x_positions[i] - avg_x);
-    s_yy += (y_positions[i] - avg_y) * (y_positions[i] - avg_y);
-  }
-
-  // Korellationskoeffizient
-  return std::abs(s_xy / std::sqrt(s_xx * s_yy));
-}
-
-inline double calculate_seeing_fwhm(std::vector<Image> &frames) {
-  Profil profil;
-
-  float fwhm_diff_sum = 0;
-  float prev_fwhm = 0;
-  int count = 0;
-
-  // Calculate the fwhm of each frame and take the difference of each
-  for (const Image &frame : frames) {
-    profil.set_from_image(frame);
-    float fwhm = profil.get_fwhm();
-    if (fwhm > 0) {
-
-      // skip first fwhm value, as it has no prev_fwhm to calculate difference
-      if (prev_fwhm > 0)
-        fwhm_diff_sum += std::abs(prev_fwhm - fwhm);
-
-      prev_fwhm = fwhm;
-      count++;
-    }
-  }
-
-  // If it failed about half of all frames we return 0 to signalize that
-  // the calculation is invalid
-  if (count < frames.size() / 2) {
-    printf("Too many frames failed to calculate fwhm, %lu of %zu\n",
-           frames.size() - count, frames.size());
-    return 0;
-  }
-
-  // Result is the average difference of the fwhm value
-  return fwhm_diff_sum / (float)count;
-}
-
-inline double calculate_seeing_average(const std::vector<Image> &frames) {
-
-  // Calculate coordinates
-  double cx, cy;
-  double mass;
-
-  std::vector<double> x_positions;
-  std::vector<double> y_positions;
-
-  int count = 0;
-  for (const Image &frame : frames) {
-    mass = calculate_centroid(frame, 0, 0, frame.get_width(), cx, cy);
-
-    if (mass <= 0.0) {
-      return 0;
-    } else {
-      x_positions.push_back(cx);
-      y_positions.push_back(cy);
-      count++;
-    }
-  }
-
-  // Calculate average
-  double avg_x = 0.0;
-  double avg_y = 0.0;
-
-  for (int i = 1; i < count; ++i) {
-    avg_x += x_positions[i] - x_positions[i - 1];
-    avg_y += y_positions[i] - y_positions[i - 1];
-  }
-
-  avg_x /= (count - 1);
-  avg_y /= (count - 1);
-
-  // Calculate scatter from Average
-  double avg_diff_x = 0.0;
-  double avg_diff_y = 0.0;
-
-  for (int i = 0; i < count; ++i) {
-    double estimated_x = x_positions[0] + avg_x * i;
-    double estimated_y = y_positions[0] + avg_y * i;
-
-    avg_diff_x += (estimated_x - x_positions[i]) * (estimated_x - x_positions[i]);
-    avg_diff_y += (estimated_y - y_positions[i]) * (estimated_y - y_positions[i]);
-  }
-
-  // Calculate seeing
-  return std::sqrt(avg_diff_x + avg_diff_y);
-}
-
 inline std::string hex_string(int length) {
   char hex_characters[] = {'0', '1', '2', '3', '4', '5', '6', '7',
                            '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
@@ -25,12 +25,15 @@ const elementStatus = $('#status')[0];
 const elementVideo = $('#video')[0];
 const ctx = elementCanvas.getContext("2d");
 
-elementVideo.src = document.location.href.replaceAll("8080/", "8081/image");
+// Selected camera, every camera has its own settings and MJPEG topic
+const cam = parseInt(new URLSearchParams(document.location.search).get("cam")) || 0;
+
+elementVideo.src = document.location.href.split("?")[0].replaceAll("8080/", "8081/image" + (cam > 0 ? cam : ""));
 
 
 function apply(id, value) {
 	if (value.length > 0) {
-		$.get(`/set/${id}/${value}`, (data) => {
+		$.get(`/set/${id}/${value}?cam=${cam}`, (data) => {
 			if (data != 'true') {
 				alert(data);
 			}
@@ -59,7 +62,7 @@ async function downloadFile(filename, text) {
 
 async function downloadImage() {
 	const element = document.createElement('a');
-	element.setAttribute('href', "/fullimage?a=" + Date.now());
+	element.setAttribute('href', `/fullimage?cam=${cam}&a=` + Date.now());
 	element.setAttribute('download', getFormatedDate() + '.png');
 	element.click();
 }
@@ -109,7 +112,7 @@ $("button[class='actionbtn']").each(function () {
 		this.innerHTML = "<img src='static/loading.gif' width='100%'></img>";
 		this.disabled = true;
 
-		$.get(`/call/${this.id}`, (data) => {
+		$.get(`/call/${this.id}?cam=${cam}`, (data) => {
 			if (this.id == "btn_download_log") {
 				if (data.startsWith("ERROR:")) {
 					alert(data);
@@ -180,7 +183,7 @@ chart.canvas.style.display = "none";
 /* When image has loaded, refresh the canvas size */
 setInterval(async () => {
 	$.ajax({
-		url: "/info",
+		url: `/info?cam=${cam}`,
 		type: "GET",
 		dataType: 'json',
 		success: (data) => {
@@ -211,10 +214,15 @@ setInterval(async () => {
 			chart.canvas.style.display = "none";
 
 			// refresh overlay canvas and draw indicators and stars
+			ctx.setTransform(1, 0, 0, 1, 0, 0);
 			ctx.clearRect(0, 0, width, height);
 
 			const {profil, stars, radius_polaris, deg_polaris, pltslv_x, pltslv_y} = data;
 
+			// Overlays are in unbinned pixels, scale them down to the displayed image
+			const bin = data["bin"] || 1;
+			ctx.setTransform(1 / bin, 0, 0, 1 / bin, 0, 0);
+
 			// Get all points for drawing a the star profil graph
 			if (profil && profil.vertical.length > 0) {
 
@@ -241,23 +249,23 @@ setInterval(async () => {
 				}
 
 				// Line to polaris
-				let polarisX = width / 2 + radius_polaris * Math.sin((Math.PI / 180) * deg_polaris);
-				let polarisY = height / 2 - radius_polaris * Math.cos((Math.PI / 180) * deg_polaris);
+				let polarisX = width * bin / 2 + radius_polaris * Math.sin((Math.PI / 180) * deg_polaris);
+				let polarisY = height * bin / 2 - radius_polaris * Math.cos((Math.PI / 180) * deg_polaris);
 				ctx.strokeStyle = 'blue';
 				ctx.lineWidth = 3;
 				ctx.beginPath();
-				ctx.moveTo(width / 2, height / 2);
+				ctx.moveTo(width * bin / 2, height * bin / 2);
 				ctx.lineTo(polarisX, polarisY);
 				ctx.stroke();
 
 				// Grid
 				for (let i = 0; i < 24; ++i) {
-					let polarisX = width / 2 + radius_polaris * Math.sin((Math.PI / 180) * (i * 15));
-					let polarisY = height / 2 - radius_polaris * Math.cos((Math.PI / 180) * (i * 15));
+					let polarisX = width * bin / 2 + radius_polaris * Math.sin((Math.PI / 180) * (i * 15));
+					let polarisY = height * bin / 2 - radius_polaris * Math.cos((Math.PI / 180) * (i * 15));
 					ctx.strokeStyle = 'gray';
 					ctx.lineWidth = 1;
 					ctx.beginPath();
-					ctx.moveTo(width / 2, height / 2);
+					ctx.moveTo(width * bin / 2, height * bin / 2);
 					ctx.lineTo(polarisX, polarisY);
 					ctx.stroke();
 				}
@@ -266,7 +274,7 @@ setInterval(async () => {
 				ctx.strokeStyle = 'blue';
 				ctx.lineWidth = 3;
 				ctx.beginPath();
-				ctx.arc(width / 2, height / 2, radius_polaris, 0, 2 * Math.PI, false);
+				ctx.arc(width * bin / 2, height * bin / 2, radius_polaris, 0, 2 * Math.PI, false);
 				ctx.lineWidth = 5;
 				ctx.stroke();
 